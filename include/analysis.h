@@ -0,0 +1,21 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "search.h"
+#include <stddef.h>
+
+#define ANALYSIS_DEFAULT_DEPTH 8
+#define ANALYSIS_DEFAULT_HASH_MB 16
+
+typedef struct
+{
+    int threads;
+    size_t hash_mb; // per worker, every worker owns its table
+    int json;       // JSON lines as positions complete, otherwise text in input order
+    search_limits limits;
+} analysis_options;
+
+// Analyses every FEN or EPD line of a file, returns 0 when the file could be read
+int analyse_file(const char *path, const analysis_options *options);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_DEFAULT_DEPTH 5
+
+// disabled holds the SEARCH_* techniques switched off for the search rows, print_stats dumps
+// the counters of every search in SEARCH_STATS builds
+int bench_run(int depth, int disabled, int print_stats);
+
+// Move generator regression check against known perft counts, nonzero on a mismatch
+int perft_run(void);
+
+#endif
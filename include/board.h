@@ -1,6 +1,7 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include "move.h"
 #include "types.h"
 
 // File masks
@@ -40,6 +41,12 @@ typedef struct
     enum square en_passant;   // en passant square
     int halfmove_clock;       // halfmove clock
     int fullmove_number;      // fullmove number
+    bitboard key;             // zobrist key
+
+    // Computed once per position by board_make_move and board_from_fen
+    bitboard checkers;         // enemy pieces giving check to the side to move
+    bitboard pinned[2];        // pieces of either color shielding the king of [color] from a slider
+    bitboard check_squares[6]; // squares from which each piece of the side to move would give check
 } board;
 
 void board_init(board *b);
@@ -58,11 +65,22 @@ int is_square_occuppied(const board *b, enum square s);
 
 void board_move_piece(board *b, enum square from, enum square to);
 
+void board_make_move(board *b, move m);
+void board_make_null_move(board *b);
+bitboard board_compute_key(const board *b);
+
+bitboard pawn_attacks(enum color c, enum square s);
 bitboard knight_attacks(enum square s);
 bitboard bishop_attacks(enum square s, bitboard occupied);
 bitboard rook_attacks(enum square s, bitboard occupied);
 bitboard queen_attacks(enum square s, bitboard occupied);
 bitboard king_attacks(enum square s);
 bitboard board_get_attacked_squares(const board *b, enum color c);
+bitboard board_attackers_to(const board *b, enum square s, bitboard occupied);
+bitboard between_squares(enum square a, enum square b);
+
+int in_check(const board *b);
+int gives_check(const board *b, move m);
+int is_legal(const board *b, move m);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include "board.h"
+
+#define MATE_SCORE 32000
+#define TB_WIN_SCORE 31000 // tablebase wins, minus the distance to mate in plies
+
+extern const int piece_value[6];
+
+int evaluate(const board *b);
+int see(const board *b, move m);
+
+#endif
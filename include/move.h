@@ -0,0 +1,52 @@
+#ifndef MOVE_H
+#define MOVE_H
+
+#include "types.h"
+
+#define MAX_MOVES 256
+#define MOVE_NONE 0
+
+// from in bits 0-5, to in bits 6-11, promotion piece in bits 12-14, flag in bits 15-16
+typedef unsigned int move;
+
+enum move_flag
+{
+    MOVE_NORMAL,
+    MOVE_PROMOTION,
+    MOVE_EN_PASSANT,
+    MOVE_CASTLING
+};
+
+typedef struct
+{
+    move moves[MAX_MOVES];
+    int count;
+} move_list;
+
+static inline move move_encode(enum square from, enum square to, enum move_flag flag, enum piece promotion)
+{
+    return from | (to << 6) | ((flag == MOVE_PROMOTION ? promotion : 0) << 12) | (flag << 15);
+}
+
+static inline enum square move_from(move m) { return (enum square)(m & 0x3F); }
+static inline enum square move_to(move m) { return (enum square)((m >> 6) & 0x3F); }
+static inline enum piece move_promotion(move m) { return (enum piece)((m >> 12) & 0x7); }
+static inline enum move_flag move_flag(move m) { return (enum move_flag)((m >> 15) & 0x3); }
+
+// 16 bit form for game records, the promotion piece is stored as its offset from the knight
+static inline unsigned short move_pack(move m)
+{
+    unsigned int promotion = move_flag(m) == MOVE_PROMOTION ? move_promotion(m) - KNIGHT : 0;
+    return (unsigned short)((m & 0xFFF) | (promotion << 12) | (move_flag(m) << 14));
+}
+
+static inline move move_unpack(unsigned short packed)
+{
+    enum move_flag flag = (enum move_flag)(packed >> 14);
+    enum piece promotion = flag == MOVE_PROMOTION ? (enum piece)(KNIGHT + ((packed >> 12) & 0x3)) : NO_PIECE;
+    return move_encode((enum square)(packed & 0x3F), (enum square)((packed >> 6) & 0x3F), flag, promotion);
+}
+
+void move_to_string(move m, char *str);
+
+#endif
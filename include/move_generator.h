@@ -0,0 +1,12 @@
+#ifndef MOVE_GENERATOR_H
+#define MOVE_GENERATOR_H
+
+#include "board.h"
+#include "move.h"
+
+void generate_moves(const board *b, move_list *list);
+void generate_legal_moves(const board *b, move_list *list);
+void generate_captures(const board *b, move_list *list);
+void generate_evasions(const board *b, move_list *list);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include "board.h"
+#include <stddef.h>
+
+#define PGN_MAX_THREADS 64
+
+enum pgn_result
+{
+    PGN_UNKNOWN,
+    PGN_WHITE_WINS,
+    PGN_BLACK_WINS,
+    PGN_DRAW
+};
+
+typedef struct
+{
+    int worker;    // thread parsing the game, callbacks run on it
+    size_t offset; // of the game's first token in the file
+    int ply;       // moves played so far
+    enum pgn_result result;
+    int error; // a tag or move could not be read, the rest of the movetext was skipped
+} pgn_game;
+
+// Either callback may be NULL, b is the position before m
+typedef struct
+{
+    void (*on_move)(void *user, const pgn_game *game, const board *b, move m);
+    void (*on_game)(void *user, const pgn_game *game);
+    void *user;
+} pgn_callbacks;
+
+typedef struct
+{
+    unsigned long long games;
+    unsigned long long moves;
+    unsigned long long errors; // games with an unreadable tag or move
+    size_t bytes;
+    double ms;
+} pgn_stats;
+
+move pgn_resolve_san(const board *b, const char *san, size_t length);
+
+void pgn_parse(const char *text, size_t length, size_t base, int worker, const pgn_callbacks *callbacks,
+               pgn_stats *stats);
+int pgn_read_file(const char *path, int threads, const pgn_callbacks *callbacks, pgn_stats *stats);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+
+// Monotonic clock, for measuring intervals only
+unsigned long long platform_ns(void);
+double platform_ms(void);
+
+// Runs run on each of count jobs of size bytes, one thread per job. The calling thread takes the
+// first job and any whose thread failed to start, returns once every job is done
+void platform_run_jobs(void *(*run)(void *), void *jobs, size_t size, int count);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "board.h"
+#include "evaluation.h"
+#include "stats.h"
+#include "transposition.h"
+
+#define MAX_PLY 128
+#define MAX_HISTORY 1024
+#define MATE_BOUND (MATE_SCORE - MAX_PLY - 256) // anything beyond is a mate or a tablebase mate
+
+// Selective search techniques, each one can be switched off through search_limits.disabled
+#define SEARCH_NULL_MOVE 1
+#define SEARCH_LMR 2
+#define SEARCH_REVERSE_FUTILITY 4
+#define SEARCH_FUTILITY 8
+#define SEARCH_LATE_MOVE_PRUNING 16
+
+typedef struct
+{
+    int depth;      // maximum depth in plies
+    int time_ms;    // 0 for no time limit
+    int print_info; // print a line per completed iteration
+    int print_stats; // dump the counters as a JSON line on stderr when the search ends, SEARCH_STATS builds only
+    int disabled;    // SEARCH_* techniques switched off
+} search_limits;
+
+typedef struct
+{
+    tt_table *tt;
+    bitboard keys[MAX_HISTORY + MAX_PLY]; // keys of the positions leading to the current one
+    int key_count;
+    search_limits limits;
+    double start_time;
+    int stop;
+    unsigned long long nodes;
+    move root_move;
+    move best_move;
+    int score;
+    int depth; // last completed depth
+#ifdef SEARCH_STATS
+    search_stats stats;
+#endif
+} search_thread;
+
+void search_init(search_thread *t, tt_table *tt);
+void search_push_history(search_thread *t, bitboard key);
+
+move search(search_thread *t, const board *b, const search_limits *limits);
+
+int search_technique(const char *name);
+int search_mate_moves(int score, int *moves);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "platform.h"
+#include <stdio.h>
+
+// Build with -DSEARCH_STATS (make STATS=1) to enable, the macros compile to nothing otherwise
+
+#define STATS_MOVE_INDEXES 16 // cutoffs at later moves share the last bucket
+#define STATS_MAX_PLY 128
+
+enum stats_timer
+{
+    STATS_MOVEGEN,
+    STATS_EVAL,
+    STATS_TOTAL,
+    STATS_TIMERS
+};
+
+// Aligned to a cache line so that threads never share one
+typedef struct
+{
+    unsigned long long nodes;
+    unsigned long long qnodes;
+    unsigned long long tt_probes;
+    unsigned long long tt_hits;
+    unsigned long long cutoffs[STATS_MOVE_INDEXES];
+    unsigned long long null_attempts;
+    unsigned long long null_researches;
+    unsigned long long lmr_attempts;
+    unsigned long long lmr_researches;
+    unsigned long long ply_nodes[STATS_MAX_PLY];
+    unsigned long long time_ns[STATS_TIMERS];
+} __attribute__((aligned(64))) search_stats;
+
+void stats_print_json(const search_stats *stats, int depth, FILE *out);
+
+#ifdef SEARCH_STATS
+#define STATS_INC(t, field) ((t)->stats.field++)
+#define STATS_CUTOFF(t, index) ((t)->stats.cutoffs[(index) < STATS_MOVE_INDEXES ? (index) : STATS_MOVE_INDEXES - 1]++)
+#define STATS_PLY(t, ply) ((t)->stats.ply_nodes[(ply) < STATS_MAX_PLY ? (ply) : STATS_MAX_PLY - 1]++)
+#define STATS_TIMER_START(name) unsigned long long name = platform_ns()
+#define STATS_TIMER_STOP(t, timer, name) ((t)->stats.time_ns[timer] += platform_ns() - (name))
+#else
+#define STATS_INC(t, field) ((void)0)
+#define STATS_CUTOFF(t, index) ((void)0)
+#define STATS_PLY(t, ply) ((void)0)
+#define STATS_TIMER_START(name) ((void)0)
+#define STATS_TIMER_STOP(t, timer, name) ((void)0)
+#endif
+
+#endif
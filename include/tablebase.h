@@ -0,0 +1,24 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "board.h"
+
+#define TB_MAX_PIECES 4
+
+// Probe results, from the point of view of the side to move
+enum tb_wdl
+{
+    TB_NONE = -1,
+    TB_DRAW,
+    TB_WIN,
+    TB_LOSS
+};
+
+int tb_init(const char *dir);
+void tb_free(void);
+
+int tb_generate(const char *ending, const char *dir, int threads);
+
+int tb_probe(const board *b, int *dtm);
+
+#endif
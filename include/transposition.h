@@ -0,0 +1,54 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include "move.h"
+#include "types.h"
+#include <stddef.h>
+
+#define TT_MAX_MB (1024 * 1024) // a terabyte, larger sizes are refused rather than wrapped
+
+enum tt_bound
+{
+    TT_NONE,
+    TT_UPPER,
+    TT_LOWER,
+    TT_EXACT
+};
+
+typedef struct
+{
+    bitboard key;
+    move best_move;
+    short score;
+    unsigned char depth;
+    unsigned char bound;
+} tt_entry;
+
+// How the table memory is backed, huge pages fall back to normal ones when refused
+enum tt_pages
+{
+    TT_PAGES_HUGE,
+    TT_PAGES_NORMAL
+};
+
+typedef struct
+{
+    tt_entry *entries;
+    size_t count; // always a power of two
+    size_t bytes; // size of the allocation, a multiple of the huge page size when mapped
+    enum tt_pages pages;
+    int mapped;  // mmap'ed with MADV_HUGEPAGE, otherwise aligned malloc
+    int threads; // threads zeroing the table in tt_clear
+} tt_table;
+
+int tt_init(tt_table *tt, size_t megabytes);
+int tt_init_pages(tt_table *tt, size_t megabytes, enum tt_pages pages, int threads);
+int tt_resize(tt_table *tt, size_t megabytes);
+void tt_set_threads(tt_table *tt, int threads);
+void tt_free(tt_table *tt);
+void tt_clear(tt_table *tt);
+
+int tt_probe(const tt_table *tt, bitboard key, tt_entry *entry);
+void tt_store(tt_table *tt, bitboard key, move best_move, int score, int depth, enum tt_bound bound);
+
+#endif
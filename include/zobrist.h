@@ -0,0 +1,13 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include "types.h"
+
+extern bitboard zobrist_piece[6][2][64];
+extern bitboard zobrist_castling[16];
+extern bitboard zobrist_en_passant[8];
+extern bitboard zobrist_side;
+
+void zobrist_init(void);
+
+#endif
@@ -1,8 +1,12 @@
 #include "board.h"
 #include "bitboard.h"
+#include "zobrist.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+static void board_update_check_info(board *b);
+
 int char_to_digit(char c)
 {
     return c - '0';
@@ -67,6 +71,7 @@ void board_set_piece(board *b, enum square s, enum piece p, enum color c)
     bitboard square_bb = 1ULL << s;
     b->piece_bb[p][c] |= square_bb;
     b->all_pieces[c] |= square_bb;
+    b->key ^= zobrist_piece[p][c][s];
 }
 
 void board_remove_piece(board *b, enum square s)
@@ -79,12 +84,89 @@ void board_remove_piece(board *b, enum square s)
     {
         b->piece_bb[p][c] &= ~square_bb;
         b->all_pieces[c] &= ~square_bb;
+        b->key ^= zobrist_piece[p][c][s];
+    }
+}
+
+static int castling_index(const board *b)
+{
+    return b->castling.white_king_side | (b->castling.white_queen_side << 1) |
+           (b->castling.black_king_side << 2) | (b->castling.black_queen_side << 3);
+}
+
+// The en passant square only counts when the side to move can take on it
+static bitboard en_passant_key(const board *b)
+{
+    enum color them = b->side_to_move == WHITE ? BLACK : WHITE;
+
+    if (b->en_passant == NO_SQUARE || !(pawn_attacks(them, b->en_passant) & b->piece_bb[PAWN][b->side_to_move]))
+        return 0;
+    return zobrist_en_passant[b->en_passant % 8];
+}
+
+bitboard board_compute_key(const board *b)
+{
+    bitboard key = 0;
+
+    for (int p = PAWN; p <= KING; p++)
+    {
+        for (int c = WHITE; c <= BLACK; c++)
+        {
+            bitboard pieces = b->piece_bb[p][c];
+            while (pieces)
+            {
+                key ^= zobrist_piece[p][c][lsb(pieces)];
+                pieces &= pieces - 1;
+            }
+        }
+    }
+
+    if (b->side_to_move == BLACK)
+        key ^= zobrist_side;
+    return key ^ zobrist_castling[castling_index(b)] ^ en_passant_key(b);
+}
+
+// Drops castling and en passant rights the placement cannot back, and rejects positions the move
+// generator cannot handle: a missing or extra king, pawns on the back ranks, or a side not to
+// move that is in check
+static int board_validate(board *b)
+{
+    enum color us = b->side_to_move;
+    enum color them = us == WHITE ? BLACK : WHITE;
+
+    if (pop_count(b->piece_bb[KING][WHITE]) != 1 || pop_count(b->piece_bb[KING][BLACK]) != 1)
+        return 0;
+    if ((b->piece_bb[PAWN][WHITE] | b->piece_bb[PAWN][BLACK]) & (RANK_1_BB | RANK_8_BB))
+        return 0;
+
+    bitboard white_home = b->piece_bb[KING][WHITE] & (1ULL << E1) ? b->piece_bb[ROOK][WHITE] : 0;
+    bitboard black_home = b->piece_bb[KING][BLACK] & (1ULL << E8) ? b->piece_bb[ROOK][BLACK] : 0;
+    b->castling.white_king_side &= (white_home >> H1) & 1;
+    b->castling.white_queen_side &= (white_home >> A1) & 1;
+    b->castling.black_king_side &= (black_home >> H8) & 1;
+    b->castling.black_queen_side &= (black_home >> A8) & 1;
+
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+
+    // The square a double push skipped, empty, with the pushed pawn in front and its origin empty
+    if (b->en_passant != NO_SQUARE)
+    {
+        bitboard rank = us == WHITE ? RANK_6_BB : RANK_3_BB;
+        enum square pushed = us == WHITE ? b->en_passant - 8 : b->en_passant + 8;
+        enum square origin = us == WHITE ? b->en_passant + 8 : b->en_passant - 8;
+        if (!(rank & (1ULL << b->en_passant)) || !(b->piece_bb[PAWN][them] & (1ULL << pushed)) ||
+            (occupied & ((1ULL << b->en_passant) | (1ULL << origin))))
+            b->en_passant = NO_SQUARE;
     }
+
+    enum square king = lsb(b->piece_bb[KING][them]);
+    return !(board_attackers_to(b, king, occupied) & b->all_pieces[us]);
 }
 
 int board_from_fen(board *b, const char *fen)
 {
-    board_init(b);
+    memset(b, 0, sizeof(board));
+    zobrist_init();
 
     int rank = 7;
     int file = 0;
@@ -94,10 +176,13 @@ int board_from_fen(board *b, const char *fen)
         if (is_digit(*fen))
         {
             file += char_to_digit(*fen);
+            if (file > 8)
+                return 0; // Invalid FEN, rank overflows
         }
         else if (*fen == '/')
         {
-            rank--;
+            if (--rank < 0)
+                return 0; // Invalid FEN, too many ranks
             file = 0;
         }
         else
@@ -127,6 +212,8 @@ int board_from_fen(board *b, const char *fen)
             default:
                 return 0; // Invalid FEN
             }
+            if (file >= 8)
+                return 0; // Invalid FEN, rank overflows
             board_set_piece(b, rank * 8 + file, p, c);
             file++;
         }
@@ -138,6 +225,10 @@ int board_from_fen(board *b, const char *fen)
         return 0; // Invalid FEN
     }
 
+    if ((fen[0] != 'w' && fen[0] != 'b') || fen[1] != ' ')
+    {
+        return 0; // Invalid FEN
+    }
     b->side_to_move = *fen == 'w' ? WHITE : BLACK;
     fen += 2;
 
@@ -174,14 +265,22 @@ int board_from_fen(board *b, const char *fen)
     if (*fen == '-')
     {
         b->en_passant = NO_SQUARE;
-        fen += 2;
+        fen++;
     }
     else
     {
+        if (fen[0] < 'a' || fen[0] > 'h' || fen[1] < '1' || fen[1] > '8')
+        {
+            return 0; // Invalid FEN, en passant square off the board
+        }
         file = fen[0] - 'a';
         rank = fen[1] - '1';
         b->en_passant = rank * 8 + file;
-        fen += 3;
+        fen += 2;
+    }
+    if (*fen && *fen++ != ' ')
+    {
+        return 0; // Invalid FEN
     }
 
     b->halfmove_clock = string_to_int(fen);
@@ -189,10 +288,20 @@ int board_from_fen(board *b, const char *fen)
     {
         fen++;
     }
-    fen++;
+    if (*fen)
+    {
+        fen++;
+    }
 
     b->fullmove_number = string_to_int(fen);
 
+    if (!board_validate(b))
+    {
+        return 0; // Invalid FEN, not a position the search can play from
+    }
+
+    b->key = board_compute_key(b);
+    board_update_check_info(b);
     return 1;
 }
 
@@ -278,20 +387,20 @@ void board_init(board *b)
     // set all pieces to their starting positions
 
     // white pieces
-    b->piece_bb[PAWN][WHITE] = 0x00FF000000000000ULL;
-    b->piece_bb[KNIGHT][WHITE] = 0x4200000000000000ULL;
-    b->piece_bb[BISHOP][WHITE] = 0x2400000000000000ULL;
-    b->piece_bb[ROOK][WHITE] = 0x8100000000000000ULL;
-    b->piece_bb[QUEEN][WHITE] = 0x0800000000000000ULL;
-    b->piece_bb[KING][WHITE] = 0x1000000000000000ULL;
+    b->piece_bb[PAWN][WHITE] = 0x000000000000FF00ULL;
+    b->piece_bb[KNIGHT][WHITE] = 0x0000000000000042ULL;
+    b->piece_bb[BISHOP][WHITE] = 0x0000000000000024ULL;
+    b->piece_bb[ROOK][WHITE] = 0x0000000000000081ULL;
+    b->piece_bb[QUEEN][WHITE] = 0x0000000000000008ULL;
+    b->piece_bb[KING][WHITE] = 0x0000000000000010ULL;
 
     // black pieces
-    b->piece_bb[PAWN][BLACK] = 0x000000000000FF00ULL;
-    b->piece_bb[KNIGHT][BLACK] = 0x0000000000000042ULL;
-    b->piece_bb[BISHOP][BLACK] = 0x0000000000000024ULL;
-    b->piece_bb[ROOK][BLACK] = 0x0000000000000081ULL;
-    b->piece_bb[QUEEN][BLACK] = 0x0000000000000008ULL;
-    b->piece_bb[KING][BLACK] = 0x0000000000000010ULL;
+    b->piece_bb[PAWN][BLACK] = 0x00FF000000000000ULL;
+    b->piece_bb[KNIGHT][BLACK] = 0x4200000000000000ULL;
+    b->piece_bb[BISHOP][BLACK] = 0x2400000000000000ULL;
+    b->piece_bb[ROOK][BLACK] = 0x8100000000000000ULL;
+    b->piece_bb[QUEEN][BLACK] = 0x0800000000000000ULL;
+    b->piece_bb[KING][BLACK] = 0x1000000000000000ULL;
 
     // all pieces
     for (int piece = PAWN; piece <= KING; piece++)
@@ -308,6 +417,10 @@ void board_init(board *b)
     b->en_passant = NO_SQUARE;
     b->halfmove_clock = 0;
     b->fullmove_number = 1;
+
+    zobrist_init();
+    b->key = board_compute_key(b);
+    board_update_check_info(b);
 }
 
 void board_print(const board *b)
@@ -359,12 +472,16 @@ enum piece board_get_piece_at(const board *b, enum square s)
     return NO_PIECE;
 }
 
-void board_make_move(board *b, enum square from, enum square to)
+void board_make_move(board *b, move m)
 {
+    enum square from = move_from(m);
+    enum square to = move_to(m);
+    enum move_flag flag = move_flag(m);
     enum piece moving_piece = board_get_piece_at(b, from);
-    enum color moving_color = board_get_color_at(b, from);
+    enum color moving_color = b->side_to_move;
     enum piece captured_piece = board_get_piece_at(b, to);
-    enum color captured_color = board_get_color_at(b, to);
+
+    b->key ^= zobrist_castling[castling_index(b)] ^ en_passant_key(b);
 
     // Remove the moving piece from its original square
     board_remove_piece(b, from);
@@ -376,73 +493,54 @@ void board_make_move(board *b, enum square from, enum square to)
     }
 
     // Place the moving piece on the destination square
-    board_set_piece(b, to, moving_piece, moving_color);
+    board_set_piece(b, to, flag == MOVE_PROMOTION ? move_promotion(m) : moving_piece, moving_color);
 
-    // Handle special pawn moves
-    if (moving_piece == PAWN)
+    // En passant capture
+    if (flag == MOVE_EN_PASSANT)
     {
-        // En passant capture
-        if (to == b->en_passant)
-        {
-            enum square captured_pawn = (moving_color == WHITE) ? to - 8 : to + 8;
-            board_remove_piece(b, captured_pawn);
-        }
+        board_remove_piece(b, moving_color == WHITE ? to - 8 : to + 8);
+        captured_piece = PAWN;
+    }
 
-        // Set en passant square if it's a double push
-        if (abs((int)from - (int)to) == 16)
-        {
-            b->en_passant = (enum square)((from + to) / 2);
-        }
-        else
-        {
-            b->en_passant = NO_SQUARE;
-        }
+    // Castling moves the rook as well
+    if (flag == MOVE_CASTLING)
+    {
+        enum square rook_from = to > from ? to + 1 : to - 2;
+        enum square rook_to = to > from ? to - 1 : to + 1;
+        board_remove_piece(b, rook_from);
+        board_set_piece(b, rook_to, ROOK, moving_color);
+    }
 
-        // Reset halfmove clock
-        b->halfmove_clock = 0;
+    // Set en passant square if it's a double push
+    if (moving_piece == PAWN && abs((int)from - (int)to) == 16)
+    {
+        b->en_passant = (enum square)((from + to) / 2);
     }
     else
     {
-        // Clear en passant square for non-pawn moves
         b->en_passant = NO_SQUARE;
-
-        // Increment halfmove clock for non-captures
-        if (captured_piece == NO_PIECE)
-        {
-            b->halfmove_clock++;
-        }
-        else
-        {
-            b->halfmove_clock = 0;
-        }
     }
 
-    // Update castling rights
-    if (moving_piece == KING)
+    // Reset halfmove clock on pawn moves and captures
+    if (moving_piece == PAWN || captured_piece != NO_PIECE)
     {
-        if (moving_color == WHITE)
-        {
-            b->castling.white_king_side = 0;
-            b->castling.white_queen_side = 0;
-        }
-        else
-        {
-            b->castling.black_king_side = 0;
-            b->castling.black_queen_side = 0;
-        }
+        b->halfmove_clock = 0;
     }
-    else if (moving_piece == ROOK)
+    else
     {
-        if (from == A1)
-            b->castling.white_queen_side = 0;
-        else if (from == H1)
-            b->castling.white_king_side = 0;
-        else if (from == A8)
-            b->castling.black_queen_side = 0;
-        else if (from == H8)
-            b->castling.black_king_side = 0;
+        b->halfmove_clock++;
     }
 
+    // Update castling rights, a rook captured on its corner loses them too
+    if (from == E1 || from == A1 || to == A1)
+        b->castling.white_queen_side = 0;
+    if (from == E1 || from == H1 || to == H1)
+        b->castling.white_king_side = 0;
+    if (from == E8 || from == A8 || to == A8)
+        b->castling.black_queen_side = 0;
+    if (from == E8 || from == H8 || to == H8)
+        b->castling.black_king_side = 0;
+
     // Switch side to move
     b->side_to_move = (b->side_to_move == WHITE) ? BLACK : WHITE;
 
@@ -451,6 +549,21 @@ void board_make_move(board *b, enum square from, enum square to)
     {
         b->fullmove_number++;
     }
+
+    b->key ^= zobrist_side ^ zobrist_castling[castling_index(b)] ^ en_passant_key(b);
+    board_update_check_info(b);
+}
+
+// Passes the move; the halfmove clock restarts so that no repetition spans a null move
+void board_make_null_move(board *b)
+{
+    b->key ^= en_passant_key(b);
+    b->en_passant = NO_SQUARE;
+    b->side_to_move = (b->side_to_move == WHITE) ? BLACK : WHITE;
+    b->key ^= zobrist_side;
+    b->halfmove_clock = 0;
+
+    board_update_check_info(b);
 }
 
 enum color board_get_color_at(const board *b, enum square s)
@@ -539,6 +652,17 @@ void board_move_piece(board *b, enum square from, enum square to)
     }
 }
 
+bitboard pawn_attacks(enum color c, enum square s)
+{
+    bitboard b = 1ULL << s;
+
+    if (c == WHITE)
+    {
+        return ((b & ~FILE_A_BB) << 7) | ((b & ~FILE_H_BB) << 9);
+    }
+    return ((b & ~FILE_H_BB) >> 7) | ((b & ~FILE_A_BB) >> 9);
+}
+
 bitboard knight_attacks(enum square s)
 {
     bitboard b = 1ULL << s;
@@ -693,4 +817,181 @@ bitboard board_get_attacked_squares(const board *b, enum color c)
     attacked_squares |= king_attacks(lsb(king));
 
     return attacked_squares;
-}
\ No newline at end of file
+}
+
+bitboard board_attackers_to(const board *b, enum square s, bitboard occupied)
+{
+    bitboard bishops_queens = b->piece_bb[BISHOP][WHITE] | b->piece_bb[BISHOP][BLACK] |
+                              b->piece_bb[QUEEN][WHITE] | b->piece_bb[QUEEN][BLACK];
+    bitboard rooks_queens = b->piece_bb[ROOK][WHITE] | b->piece_bb[ROOK][BLACK] |
+                            b->piece_bb[QUEEN][WHITE] | b->piece_bb[QUEEN][BLACK];
+
+    return (pawn_attacks(BLACK, s) & b->piece_bb[PAWN][WHITE]) |
+           (pawn_attacks(WHITE, s) & b->piece_bb[PAWN][BLACK]) |
+           (knight_attacks(s) & (b->piece_bb[KNIGHT][WHITE] | b->piece_bb[KNIGHT][BLACK])) |
+           (king_attacks(s) & (b->piece_bb[KING][WHITE] | b->piece_bb[KING][BLACK])) |
+           (bishop_attacks(s, occupied) & bishops_queens) |
+           (rook_attacks(s, occupied) & rooks_queens);
+}
+
+// Squares strictly between two squares on a common line, empty if they share none
+bitboard between_squares(enum square a, enum square b)
+{
+    bitboard a_bb = 1ULL << a;
+    bitboard b_bb = 1ULL << b;
+
+    if (rook_attacks(a, 0) & b_bb)
+        return rook_attacks(a, b_bb) & rook_attacks(b, a_bb);
+    if (bishop_attacks(a, 0) & b_bb)
+        return bishop_attacks(a, b_bb) & bishop_attacks(b, a_bb);
+    return 0;
+}
+
+static int aligned(enum square a, enum square b, enum square c)
+{
+    bitboard line = 0;
+
+    if (rook_attacks(a, 0) & (1ULL << b))
+        line = rook_attacks(a, 0) & rook_attacks(b, 0);
+    else if (bishop_attacks(a, 0) & (1ULL << b))
+        line = bishop_attacks(a, 0) & bishop_attacks(b, 0);
+
+    return ((line | (1ULL << a) | (1ULL << b)) & (1ULL << c)) != 0;
+}
+
+// X-rays from the king through the first piece on each ray; whatever stands
+// between the king and an enemy slider found that way is a blocker
+static bitboard board_blockers(const board *b, enum color c)
+{
+    enum square king = lsb(b->piece_bb[KING][c]);
+    enum color them = c == WHITE ? BLACK : WHITE;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+    bitboard blockers = 0;
+
+    bitboard rays = rook_attacks(king, occupied);
+    bitboard snipers = rook_attacks(king, occupied & ~rays) & ~rays &
+                       (b->piece_bb[ROOK][them] | b->piece_bb[QUEEN][them]);
+    while (snipers)
+    {
+        blockers |= rook_attacks(lsb(snipers), occupied) & rays & occupied;
+        snipers &= snipers - 1;
+    }
+
+    rays = bishop_attacks(king, occupied);
+    snipers = bishop_attacks(king, occupied & ~rays) & ~rays &
+              (b->piece_bb[BISHOP][them] | b->piece_bb[QUEEN][them]);
+    while (snipers)
+    {
+        blockers |= bishop_attacks(lsb(snipers), occupied) & rays & occupied;
+        snipers &= snipers - 1;
+    }
+
+    return blockers;
+}
+
+static void board_update_check_info(board *b)
+{
+    enum color us = b->side_to_move;
+    enum color them = us == WHITE ? BLACK : WHITE;
+    enum square king = lsb(b->piece_bb[KING][us]);
+    enum square their_king = lsb(b->piece_bb[KING][them]);
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+
+    b->checkers = board_attackers_to(b, king, occupied) & b->all_pieces[them];
+    b->pinned[WHITE] = board_blockers(b, WHITE);
+    b->pinned[BLACK] = board_blockers(b, BLACK);
+
+    b->check_squares[PAWN] = pawn_attacks(them, their_king);
+    b->check_squares[KNIGHT] = knight_attacks(their_king);
+    b->check_squares[BISHOP] = bishop_attacks(their_king, occupied);
+    b->check_squares[ROOK] = rook_attacks(their_king, occupied);
+    b->check_squares[QUEEN] = b->check_squares[BISHOP] | b->check_squares[ROOK];
+    b->check_squares[KING] = 0;
+}
+
+int in_check(const board *b)
+{
+    return b->checkers != 0;
+}
+
+int gives_check(const board *b, move m)
+{
+    enum color them = b->side_to_move == WHITE ? BLACK : WHITE;
+    enum square from = move_from(m);
+    enum square to = move_to(m);
+    enum square their_king = lsb(b->piece_bb[KING][them]);
+
+    if (move_flag(m) == MOVE_PROMOTION)
+    {
+        // The vacated square may open the promoted piece's line to the king
+        bitboard occupied = (b->all_pieces[WHITE] | b->all_pieces[BLACK]) & ~(1ULL << from);
+        bitboard attacks = 0;
+        switch (move_promotion(m))
+        {
+        case KNIGHT:
+            attacks = knight_attacks(to);
+            break;
+        case BISHOP:
+            attacks = bishop_attacks(to, occupied);
+            break;
+        case ROOK:
+            attacks = rook_attacks(to, occupied);
+            break;
+        default:
+            attacks = queen_attacks(to, occupied);
+            break;
+        }
+        if (attacks & (1ULL << their_king))
+            return 1;
+    }
+    else if (b->check_squares[board_get_piece_at(b, from)] & (1ULL << to))
+    {
+        return 1;
+    }
+
+    // Discovered check
+    if ((b->pinned[them] & (1ULL << from)) && !aligned(from, their_king, to))
+        return 1;
+
+    // Rare enough to simply play out
+    if (move_flag(m) == MOVE_EN_PASSANT || move_flag(m) == MOVE_CASTLING)
+    {
+        board after = *b;
+        board_make_move(&after, m);
+        return after.checkers != 0;
+    }
+
+    return 0;
+}
+
+// Legality of a pseudo-legal move
+int is_legal(const board *b, move m)
+{
+    enum color us = b->side_to_move;
+    enum color them = us == WHITE ? BLACK : WHITE;
+    enum square from = move_from(m);
+    enum square to = move_to(m);
+    enum square king = lsb(b->piece_bb[KING][us]);
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+
+    if (move_flag(m) == MOVE_EN_PASSANT)
+    {
+        bitboard captured = 1ULL << (us == WHITE ? to - 8 : to + 8);
+        occupied = (occupied ^ (1ULL << from) ^ captured) | (1ULL << to);
+        return !(board_attackers_to(b, king, occupied) & b->all_pieces[them] & ~captured);
+    }
+
+    if (from == king)
+        return !(board_attackers_to(b, to, occupied ^ (1ULL << from)) & b->all_pieces[them]);
+
+    if (b->checkers)
+    {
+        // Double check leaves only king moves, single check needs a capture or a block
+        if (b->checkers & (b->checkers - 1))
+            return 0;
+        if (!((between_squares(king, lsb(b->checkers)) | b->checkers) & (1ULL << to)))
+            return 0;
+    }
+
+    return !(b->pinned[us] & (1ULL << from)) || aligned(from, king, to);
+}
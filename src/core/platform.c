@@ -0,0 +1,39 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "platform.h"
+#include <pthread.h>
+#include <time.h>
+
+unsigned long long platform_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+double platform_ms(void)
+{
+    return platform_ns() / 1e6;
+}
+
+void platform_run_jobs(void *(*run)(void *), void *jobs, size_t size, int count)
+{
+    if (count < 1)
+        return;
+
+    unsigned char *job = jobs;
+    pthread_t handles[count];
+    int started[count];
+
+    for (int i = 1; i < count; i++)
+        started[i] = pthread_create(&handles[i], NULL, run, job + i * size) == 0;
+
+    run(job);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+            pthread_join(handles[i], NULL);
+        else
+            run(job + i * size);
+    }
+}
@@ -0,0 +1,55 @@
+#include "zobrist.h"
+#include <pthread.h>
+
+bitboard zobrist_piece[6][2][64];
+bitboard zobrist_castling[16];
+bitboard zobrist_en_passant[8];
+bitboard zobrist_side;
+
+// xorshift64*, fixed seed so keys are the same on every run
+static bitboard zobrist_random(bitboard *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static void zobrist_build(void)
+{
+    bitboard state = 1070372ULL;
+
+    for (int p = 0; p < 6; p++)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            for (int s = 0; s < 64; s++)
+                zobrist_piece[p][c][s] = zobrist_random(&state);
+        }
+    }
+
+    // Each castling combination is the xor of its individual rights
+    bitboard rights[4];
+    for (int i = 0; i < 4; i++)
+        rights[i] = zobrist_random(&state);
+    for (int i = 0; i < 16; i++)
+    {
+        zobrist_castling[i] = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            if (i & (1 << j))
+                zobrist_castling[i] ^= rights[j];
+        }
+    }
+
+    for (int f = 0; f < 8; f++)
+        zobrist_en_passant[f] = zobrist_random(&state);
+    zobrist_side = zobrist_random(&state);
+}
+
+// Built once whichever thread gets here first, PGN and analyse parse positions in parallel
+void zobrist_init(void)
+{
+    static pthread_once_t keys_once = PTHREAD_ONCE_INIT;
+    pthread_once(&keys_once, zobrist_build);
+}
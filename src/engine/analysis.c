@@ -0,0 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "analysis.h"
+#include "bitboard.h"
+#include "evaluation.h"
+#include "platform.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANALYSIS_LINE 1024
+#define ANALYSIS_ID 64
+
+typedef struct
+{
+    board b;
+    int line; // line number in the file
+    char id[ANALYSIS_ID];
+} analysis_position;
+
+typedef struct
+{
+    move best_move;
+    int score;
+    int depth;
+    unsigned long long nodes;
+    double ms;
+    int done;
+} analysis_result;
+
+// Chase-Lev deque over a task list filled before the workers start, so it never grows:
+// the owner pops at the bottom, thieves take from the top
+typedef struct
+{
+    long top __attribute__((aligned(64)));
+    long bottom __attribute__((aligned(64)));
+    int *tasks;
+} analysis_deque;
+
+typedef struct
+{
+    const analysis_options *options;
+    analysis_position *positions;
+    analysis_result *results;
+    int count;
+    analysis_deque *deques; // one per worker
+    int threads;
+    int next_output; // first position not printed yet, text output only
+    pthread_mutex_t output;
+} analysis_run;
+
+typedef struct
+{
+    analysis_run *run;
+    int index;
+    tt_table tt;
+    search_thread *search;
+    unsigned long long steals;
+} analysis_worker;
+
+// Owner side, -1 once the deque is empty
+static int deque_pop(analysis_deque *d)
+{
+    long bottom = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (top > bottom)
+    {
+        __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    int task = d->tasks[bottom];
+    if (top == bottom)
+    {
+        // Last task, a thief may be after it too
+        if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = -1;
+        __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+// Thief side, -1 when empty and -2 when another thread won the race
+static int deque_steal(analysis_deque *d)
+{
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long bottom = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom)
+        return -1;
+
+    int task = d->tasks[top];
+    if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return -2;
+    return task;
+}
+
+// Tries every other worker in turn, tasks are never added so all empty means done
+static int analysis_steal(analysis_worker *w)
+{
+    analysis_run *run = w->run;
+    int contended;
+
+    do
+    {
+        contended = 0;
+        for (int i = 1; i < run->threads; i++)
+        {
+            int task = deque_steal(&run->deques[(w->index + i) % run->threads]);
+            if (task >= 0)
+            {
+                w->steals++;
+                return task;
+            }
+            contended |= task == -2;
+        }
+    } while (contended);
+
+    return -1;
+}
+
+static void print_text(const analysis_run *run, int index)
+{
+    const analysis_position *pos = &run->positions[index];
+    const analysis_result *r = &run->results[index];
+    char move_str[6];
+
+    move_to_string(r->best_move, move_str);
+    printf("%d bestmove %s ", pos->line, move_str);
+    int mate;
+    if (search_mate_moves(r->score, &mate))
+        printf("score mate %d ", mate);
+    else
+        printf("score cp %d ", r->score);
+    printf("depth %d nodes %llu time %.0f", r->depth, r->nodes, r->ms);
+    if (pos->id[0])
+        printf(" id \"%s\"", pos->id);
+    putchar('\n');
+}
+
+static void print_json(const analysis_run *run, int index)
+{
+    const analysis_position *pos = &run->positions[index];
+    const analysis_result *r = &run->results[index];
+    char move_str[6];
+
+    move_to_string(r->best_move, move_str);
+    printf("{\"index\":%d,\"line\":%d,", index, pos->line);
+    if (pos->id[0])
+    {
+        printf("\"id\":\"");
+        for (const char *c = pos->id; *c; c++)
+            printf(*c == '\\' ? "\\\\" : "%c", *c);
+        printf("\",");
+    }
+    printf("\"bestmove\":\"%s\",", move_str);
+    int mate;
+    if (search_mate_moves(r->score, &mate))
+        printf("\"mate\":%d,", mate);
+    else
+        printf("\"cp\":%d,", r->score);
+    printf("\"depth\":%d,\"nodes\":%llu,\"time_ms\":%.3f}\n", r->depth, r->nodes, r->ms);
+}
+
+// JSON lines go out as positions finish, text waits until every earlier position is done
+static void analysis_emit(analysis_run *run, int index)
+{
+    pthread_mutex_lock(&run->output);
+    run->results[index].done = 1;
+    if (run->options->json)
+    {
+        print_json(run, index);
+    }
+    else
+    {
+        while (run->next_output < run->count && run->results[run->next_output].done)
+            print_text(run, run->next_output++);
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&run->output);
+}
+
+static void *analysis_worker_run(void *arg)
+{
+    analysis_worker *w = arg;
+    analysis_run *run = w->run;
+
+    for (;;)
+    {
+        int task = deque_pop(&run->deques[w->index]);
+        if (task < 0)
+            task = analysis_steal(w);
+        if (task < 0)
+            break;
+
+        // The table is kept between positions, it is only a cache
+        double start = platform_ms();
+        search_init(w->search, &w->tt);
+        move best = search(w->search, &run->positions[task].b, &run->options->limits);
+
+        analysis_result *r = &run->results[task];
+        r->best_move = best;
+        r->score = w->search->score;
+        r->depth = w->search->depth;
+        r->nodes = w->search->nodes;
+        r->ms = platform_ms() - start;
+        analysis_emit(run, task);
+    }
+
+    return NULL;
+}
+
+// Accepts full FENs and EPD lines, whose operations follow the four position fields
+static int parse_position(char *line, analysis_position *pos)
+{
+    char *fields[4];
+    char *rest = line;
+    int count = 0;
+
+    while (count < 4)
+    {
+        while (isspace((unsigned char)*rest))
+            rest++;
+        if (!*rest)
+            break;
+        fields[count++] = rest;
+        while (*rest && !isspace((unsigned char)*rest))
+            rest++;
+        if (*rest)
+            *rest++ = '\0';
+    }
+    if (count < 4)
+        return 0;
+
+    int halfmove = 0;
+    int fullmove = 1;
+    int clocks = sscanf(rest, "%d %d", &halfmove, &fullmove) == 2;
+    if (!clocks)
+    {
+        halfmove = 0;
+        fullmove = 1;
+    }
+    char fen[ANALYSIS_LINE];
+    snprintf(fen, sizeof(fen), "%s %s %s %s %d %d", fields[0], fields[1], fields[2], fields[3], halfmove, fullmove);
+
+    // Of the EPD operations only the id is kept
+    pos->id[0] = '\0';
+    char *id = clocks ? NULL : strstr(rest, "id \"");
+    if (id && (id == rest || id[-1] == ' ' || id[-1] == ';'))
+    {
+        id += 4;
+        size_t length = strcspn(id, "\"");
+        if (length >= ANALYSIS_ID)
+            length = ANALYSIS_ID - 1;
+        memcpy(pos->id, id, length);
+        pos->id[length] = '\0';
+    }
+
+    return board_from_fen(&pos->b, fen);
+}
+
+static analysis_position *load_positions(const char *path, int *count)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return NULL;
+
+    analysis_position *positions = NULL;
+    int capacity = 0;
+    int line_number = 0;
+    char line[ANALYSIS_LINE];
+    *count = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0' || line[0] == '#')
+            continue;
+
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            analysis_position *grown = realloc(positions, capacity * sizeof(analysis_position));
+            if (!grown)
+            {
+                free(positions);
+                fclose(file);
+                return NULL;
+            }
+            positions = grown;
+        }
+
+        analysis_position *pos = &positions[*count];
+        pos->line = line_number;
+        if (parse_position(line, pos))
+            (*count)++;
+        else
+            fprintf(stderr, "analyse: line %d is not a position, skipped\n", line_number);
+    }
+
+    fclose(file);
+    return positions ? positions : malloc(sizeof(analysis_position));
+}
+
+int analyse_file(const char *path, const analysis_options *options)
+{
+    analysis_run run;
+    memset(&run, 0, sizeof(run));
+    run.options = options;
+    run.positions = load_positions(path, &run.count);
+    if (!run.positions)
+    {
+        fprintf(stderr, "analyse: cannot read %s\n", path);
+        return 1;
+    }
+
+    run.threads = options->threads > 0 ? options->threads : 1;
+    if (run.threads > run.count)
+        run.threads = run.count > 0 ? run.count : 1;
+
+    int *tasks = malloc((run.count + 1) * sizeof(int));
+    run.results = calloc(run.count + 1, sizeof(analysis_result));
+    run.deques = calloc(run.threads, sizeof(analysis_deque));
+    analysis_worker *workers = calloc(run.threads, sizeof(analysis_worker));
+    pthread_t *handles = malloc(run.threads * sizeof(pthread_t));
+    pthread_mutex_init(&run.output, NULL);
+
+    int ready = tasks && run.results && run.deques && workers && handles;
+
+    // Round robin, and each deque holds its positions in reverse so the owner goes through them
+    // in input order while thieves start with the latest ones
+    int offset = 0;
+    for (int w = 0; ready && w < run.threads; w++)
+    {
+        int owned = (run.count - w + run.threads - 1) / run.threads;
+        run.deques[w].tasks = tasks + offset;
+        run.deques[w].top = 0;
+        run.deques[w].bottom = owned;
+        for (int k = 0; k < owned; k++)
+            run.deques[w].tasks[k] = w + (owned - 1 - k) * run.threads;
+        offset += owned;
+
+        workers[w].run = &run;
+        workers[w].index = w;
+        if (posix_memalign((void **)&workers[w].search, 64, sizeof(search_thread)) != 0)
+            workers[w].search = NULL;
+        // Tables are set up before any worker starts, so each first touch uses every thread
+        if (!workers[w].search ||
+            !tt_init_pages(&workers[w].tt, options->hash_mb, TT_PAGES_HUGE, run.threads))
+            ready = 0;
+    }
+
+    int started = 0;
+    double start = platform_ms();
+    for (; ready && started < run.threads; started++)
+    {
+        if (pthread_create(&handles[started], NULL, analysis_worker_run, &workers[started]) != 0)
+            break;
+    }
+    if (ready && started == 0)
+        analysis_worker_run(&workers[0]);
+
+    unsigned long long nodes = 0;
+    unsigned long long steals = 0;
+    for (int w = 0; w < started; w++)
+        pthread_join(handles[w], NULL);
+    double elapsed = platform_ms() - start;
+
+    for (int w = 0; ready && w < run.threads; w++)
+        steals += workers[w].steals;
+    for (int i = 0; ready && i < run.count; i++)
+        nodes += run.results[i].nodes;
+
+    if (ready)
+    {
+        fprintf(stderr, "Positions       : %d\n", run.count);
+        fprintf(stderr, "Threads         : %d\n", run.threads);
+        fprintf(stderr, "Steals          : %llu\n", steals);
+        fprintf(stderr, "Nodes searched  : %llu\n", nodes);
+        fprintf(stderr, "Time (ms)       : %.0f\n", elapsed);
+        fprintf(stderr, "Positions/minute: %.0f\n", run.count * 60000.0 / (elapsed > 0 ? elapsed : 1e-3));
+        fprintf(stderr, "Nodes/second    : %.0f\n", nodes * 1000.0 / (elapsed > 0 ? elapsed : 1e-3));
+    }
+    else
+    {
+        fprintf(stderr, "analyse: out of memory\n");
+    }
+
+    for (int w = 0; workers && w < run.threads; w++)
+    {
+        if (workers[w].tt.entries)
+            tt_free(&workers[w].tt);
+        free(workers[w].search);
+    }
+    pthread_mutex_destroy(&run.output);
+    free(handles);
+    free(workers);
+    free(run.deques);
+    free(run.results);
+    free(tasks);
+    free(run.positions);
+    return ready ? 0 : 1;
+}
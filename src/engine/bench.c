@@ -0,0 +1,508 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+#include "bitboard.h"
+#include "evaluation.h"
+#include "move_generator.h"
+#include "platform.h"
+#include "search.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_HASH_MB 16
+#define BENCH_PAGES_MB 256 // well past what the TLB covers with 4 KB pages
+
+static const char *bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+    "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+    "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+    "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+    "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+    "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+    "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+    "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+    "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+    "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+    "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+    "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+    "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+    "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+    "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+    "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+    "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+    "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+    "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+    "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+    "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+    "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+    "8/8/8/8/8/6k1/6p1/6K1 w - - 0 1",
+    "7k/7P/6K1/8/3B4/8/8/8 b - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "8/8/4k3/8/2p5/8/B2P4/4K3 w - - 0 1",
+};
+
+#define BENCH_POSITIONS ((int)(sizeof(bench_positions) / sizeof(bench_positions[0])))
+
+// Blocked endgames where the kings can only shuffle, for the cost of a long game history
+static const char *history_positions[] = {
+    "8/8/3k4/1p1p1p2/1P1P1P2/3K4/8/8 w - - 0 1",
+    "8/4k3/8/p1p1p1p1/P1P1P1P1/8/4K3/8 w - - 0 1",
+    "8/8/2k5/p1p5/P1P2p2/5P2/4K3/8 w - - 0 1",
+};
+
+#define HISTORY_POSITIONS ((int)(sizeof(history_positions) / sizeof(history_positions[0])))
+#define HISTORY_PLIES 200 // shuffling before the searched position
+#define HISTORY_CLOCK 60  // plies since the last pawn move, as far back as repetitions are looked for
+#define HISTORY_DEPTH 16
+
+// Keeps results alive so the compiler cannot drop the measured work
+static volatile bitboard bench_sink;
+
+static void bench_row(const char *name, unsigned long long count, double ms)
+{
+    printf("%s,%llu,%.3f,%.2f,%.0f\n", name, count, ms, ms * 1e6 / count, count * 1000.0 / (ms > 0 ? ms : 1e-3));
+}
+
+static void bench_bitboard(void)
+{
+    bitboard bbs[64];
+    bitboard state = 0x9E3779B97F4A7C15ULL;
+    unsigned long long iterations = 0;
+    bitboard sink = 0;
+
+    for (int i = 0; i < 64; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        bbs[i] = state & (state >> 3);
+    }
+
+    double start = platform_ms();
+    for (int r = 0; r < 200000; r++)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            sink += pop_count(bbs[i]);
+            iterations++;
+        }
+    }
+    bench_row("pop_count", iterations, platform_ms() - start);
+
+    iterations = 0;
+    start = platform_ms();
+    for (int r = 0; r < 200000; r++)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            sink += lsb(bbs[i] | (1ULL << (r & 63)));
+            iterations++;
+        }
+    }
+    bench_row("lsb", iterations, platform_ms() - start);
+    bench_sink = sink;
+}
+
+static void bench_attacks(const board *boards)
+{
+    bitboard sink = 0;
+    unsigned long long iterations = 0;
+    double start = platform_ms();
+
+    for (int r = 0; r < 500; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            bitboard occupied = boards[p].all_pieces[WHITE] | boards[p].all_pieces[BLACK];
+            for (enum square s = A1; s <= H8; s++)
+            {
+                sink ^= knight_attacks(s) ^ king_attacks(s) ^ bishop_attacks(s, occupied) ^ rook_attacks(s, occupied);
+                iterations++;
+            }
+        }
+    }
+    bench_row("attacks_nbrk", iterations, platform_ms() - start);
+
+    iterations = 0;
+    start = platform_ms();
+    for (int r = 0; r < 200; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            bitboard occupied = boards[p].all_pieces[WHITE] | boards[p].all_pieces[BLACK];
+            for (enum square s = A1; s <= H8; s++)
+            {
+                sink ^= board_attackers_to(&boards[p], s, occupied);
+                iterations++;
+            }
+        }
+    }
+    bench_row("attackers_to", iterations, platform_ms() - start);
+    bench_sink = sink;
+}
+
+static void bench_movegen(const board *boards)
+{
+    move_list list;
+    unsigned long long iterations = 0, moves = 0;
+    double start = platform_ms();
+
+    for (int r = 0; r < 20000; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            generate_moves(&boards[p], &list);
+            moves += list.count;
+            iterations++;
+        }
+    }
+    bench_row("generate_moves", iterations, platform_ms() - start);
+
+    iterations = 0;
+    start = platform_ms();
+    for (int r = 0; r < 5000; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            generate_legal_moves(&boards[p], &list);
+            moves += list.count;
+            iterations++;
+        }
+    }
+    bench_row("generate_legal_moves", iterations, platform_ms() - start);
+    bench_sink = moves;
+}
+
+// The search makes moves on a copy, so unmaking is dropping the copy
+static void bench_make_move(const board *boards)
+{
+    move_list lists[BENCH_POSITIONS];
+    bitboard sink = 0;
+    unsigned long long iterations = 0;
+
+    for (int p = 0; p < BENCH_POSITIONS; p++)
+        generate_legal_moves(&boards[p], &lists[p]);
+
+    double start = platform_ms();
+    for (int r = 0; r < 1000; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            for (int i = 0; i < lists[p].count; i++)
+            {
+                board child = boards[p];
+                board_make_move(&child, lists[p].moves[i]);
+                sink ^= child.key;
+                iterations++;
+            }
+        }
+    }
+    bench_row("make_move", iterations, platform_ms() - start);
+    bench_sink = sink;
+}
+
+static void bench_evaluate(const board *boards)
+{
+    int sink = 0;
+    unsigned long long iterations = 0;
+    double start = platform_ms();
+
+    for (int r = 0; r < 50000; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            sink += evaluate(&boards[p]);
+            iterations++;
+        }
+    }
+    bench_row("evaluate", iterations, platform_ms() - start);
+    bench_sink = sink;
+}
+
+static void bench_hashing(const board *boards)
+{
+    tt_table tt;
+    tt_entry entry;
+    bitboard sink = 0;
+    unsigned long long iterations = 0;
+    double start = platform_ms();
+
+    for (int r = 0; r < 50000; r++)
+    {
+        for (int p = 0; p < BENCH_POSITIONS; p++)
+        {
+            sink ^= board_compute_key(&boards[p]);
+            iterations++;
+        }
+    }
+    bench_row("compute_key", iterations, platform_ms() - start);
+
+    if (!tt_init(&tt, BENCH_HASH_MB))
+        return;
+
+    iterations = 0;
+    start = platform_ms();
+    for (unsigned long long i = 0; i < 5000000; i++)
+    {
+        bitboard key = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        tt_store(&tt, key, MOVE_NONE, 0, (int)(i & 15), TT_EXACT);
+        sink += tt_probe(&tt, key ^ (i & 1), &entry);
+        iterations++;
+    }
+    bench_row("tt_store_probe", iterations, platform_ms() - start);
+
+    tt_free(&tt);
+    bench_sink = sink;
+}
+
+// Allocation, clear and dependent probe latency of a large table, per page mode
+static void bench_pages(enum tt_pages pages, int threads)
+{
+    tt_table tt;
+    tt_entry entry;
+    const char *suffix = pages == TT_PAGES_HUGE ? "huge" : "normal";
+    char name[32];
+
+    double start = platform_ms();
+    if (!tt_init_pages(&tt, BENCH_PAGES_MB, pages, threads))
+        return;
+    snprintf(name, sizeof(name), "tt_init_%s", suffix);
+    bench_row(name, tt.bytes >> 20, platform_ms() - start);
+
+    start = platform_ms();
+    for (int r = 0; r < 10; r++)
+        tt_clear(&tt);
+    snprintf(name, sizeof(name), "tt_clear_%s", suffix);
+    bench_row(name, 10 * (tt.bytes >> 20), platform_ms() - start);
+
+    // Every slot names the next one to probe, a full period LCG, so misses cannot overlap
+    bitboard key = 0;
+    unsigned long long iterations = 4000000;
+    for (bitboard i = 0; i < tt.count; i++)
+        tt_store(&tt, i, (move)((i * 0x5851F42D4C957F2DULL + 0x14057B7EF767814FULL) & (tt.count - 1)), 0, 1, TT_EXACT);
+
+    start = platform_ms();
+    for (unsigned long long i = 0; i < iterations; i++)
+    {
+        tt_probe(&tt, key, &entry);
+        key = entry.best_move;
+    }
+    snprintf(name, sizeof(name), "tt_probe_%s", suffix);
+    bench_row(name, iterations, platform_ms() - start);
+
+    if (pages == TT_PAGES_HUGE)
+        fprintf(stderr, "Huge pages      : %s\n", tt.mapped ? "madvise" : "refused, aligned malloc");
+    tt_free(&tt);
+    bench_sink = key;
+}
+
+// Fixed depth searches from a cleared hash table give the same node count on every
+// machine, that total is the signature of the search's behaviour
+static void bench_search(const board *boards, int depth, int disabled, int print_stats)
+{
+    tt_table tt;
+    search_thread *t = NULL;
+    search_limits limits = {depth, 0, 0, print_stats, disabled};
+    unsigned long long total = 0;
+    double elapsed = 0;
+    char name[32];
+
+    // The counters in STATS builds are cache line aligned, malloc does not promise that
+    if (posix_memalign((void **)&t, 64, sizeof(search_thread)) != 0 || !tt_init(&tt, BENCH_HASH_MB))
+    {
+        free(t);
+        fprintf(stderr, "bench: out of memory\n");
+        return;
+    }
+
+    for (int p = 0; p < BENCH_POSITIONS; p++)
+    {
+        tt_clear(&tt);
+        search_init(t, &tt);
+
+        double start = platform_ms();
+        search(t, &boards[p], &limits);
+        double ms = platform_ms() - start;
+
+        snprintf(name, sizeof(name), "search_%02d", p + 1);
+        bench_row(name, t->nodes, ms);
+        total += t->nodes;
+        elapsed += ms;
+    }
+
+    bench_row("search_total", total, elapsed);
+    fprintf(stderr, "Nodes searched  : %llu\n", total);
+    fprintf(stderr, "Nodes/second    : %.0f\n", total * 1000.0 / (elapsed > 0 ? elapsed : 1e-3));
+
+    tt_free(&tt);
+    free(t);
+}
+
+// Each endgame is shuffled for HISTORY_PLIES with king moves, then the final position is searched
+// without and with those plies fed through search_push_history. The repetition scans stop at the
+// last irreversible move, so the longer history should cost next to nothing per node
+static void bench_history(void)
+{
+    tt_table tt;
+    search_thread *t = NULL;
+    search_limits limits = {HISTORY_DEPTH, 0, 0, 0, 0};
+    unsigned long long nodes[2] = {0, 0};
+    double elapsed[2] = {0, 0};
+
+    if (posix_memalign((void **)&t, 64, sizeof(search_thread)) != 0 || !tt_init(&tt, BENCH_HASH_MB))
+    {
+        free(t);
+        fprintf(stderr, "bench: out of memory\n");
+        return;
+    }
+
+    for (int p = 0; p < HISTORY_POSITIONS; p++)
+    {
+        board b;
+        bitboard keys[HISTORY_PLIES];
+        board_from_fen(&b, history_positions[p]);
+
+        // Walks the kings around, a fixed choice per ply so the history is the same on every run
+        for (int ply = 0; ply < HISTORY_PLIES; ply++)
+        {
+            move_list list;
+            move kings[MAX_MOVES];
+            int count = 0;
+            generate_legal_moves(&b, &list);
+            for (int i = 0; i < list.count; i++)
+            {
+                if (board_get_piece_at(&b, move_from(list.moves[i])) == KING)
+                    kings[count++] = list.moves[i];
+            }
+
+            keys[ply] = b.key;
+            if (count > 0)
+                board_make_move(&b, kings[(ply / 2 * 7) % count]);
+        }
+        b.halfmove_clock = HISTORY_CLOCK;
+
+        for (int with_history = 0; with_history < 2; with_history++)
+        {
+            tt_clear(&tt);
+            search_init(t, &tt);
+            for (int ply = 0; with_history && ply < HISTORY_PLIES; ply++)
+                search_push_history(t, keys[ply]);
+
+            double start = platform_ms();
+            search(t, &b, &limits);
+            elapsed[with_history] += platform_ms() - start;
+            nodes[with_history] += t->nodes;
+        }
+    }
+
+    bench_row("search_no_history", nodes[0], elapsed[0]);
+    bench_row("search_history_200", nodes[1], elapsed[1]);
+
+    tt_free(&tt);
+    free(t);
+}
+
+// Standard perft positions with their known node counts
+static const struct
+{
+    const char *fen;
+    int depth;
+    unsigned long long nodes;
+} perft_positions[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609ULL},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603ULL},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624ULL},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333ULL},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487ULL},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594ULL},
+};
+
+// Leaves are counted from the legal move list; on the way every child is checked against
+// gives_check and a full recomputation of its key
+static unsigned long long perft(const board *b, int depth, unsigned long long *mismatches)
+{
+    move_list list;
+    generate_legal_moves(b, &list);
+    if (depth <= 1)
+        return (unsigned long long)list.count;
+
+    unsigned long long nodes = 0;
+    for (int i = 0; i < list.count; i++)
+    {
+        board child = *b;
+        board_make_move(&child, list.moves[i]);
+        *mismatches += gives_check(b, list.moves[i]) != (child.checkers != 0);
+        *mismatches += child.key != board_compute_key(&child);
+        nodes += perft(&child, depth - 1, mismatches);
+    }
+    return nodes;
+}
+
+int perft_run(void)
+{
+    int failures = 0;
+
+    printf("position,depth,nodes,expected,mismatches,time_ms\n");
+    for (int p = 0; p < (int)(sizeof(perft_positions) / sizeof(perft_positions[0])); p++)
+    {
+        board b;
+        unsigned long long mismatches = 0;
+        board_from_fen(&b, perft_positions[p].fen);
+
+        double start = platform_ms();
+        unsigned long long nodes = perft(&b, perft_positions[p].depth, &mismatches);
+        printf("%d,%d,%llu,%llu,%llu,%.0f\n", p + 1, perft_positions[p].depth, nodes, perft_positions[p].nodes,
+               mismatches, platform_ms() - start);
+        failures += nodes != perft_positions[p].nodes || mismatches != 0;
+    }
+
+    fprintf(stderr, failures ? "perft: %d positions FAILED\n" : "perft: all positions match\n", failures);
+    return failures != 0;
+}
+
+int bench_run(int depth, int disabled, int print_stats)
+{
+    board boards[BENCH_POSITIONS];
+
+    for (int p = 0; p < BENCH_POSITIONS; p++)
+        board_from_fen(&boards[p], bench_positions[p]);
+
+    // CSV on stdout, the signature summary on stderr
+    printf("benchmark,count,time_ms,ns_per_op,per_second\n");
+    bench_bitboard();
+    bench_attacks(boards);
+    bench_movegen(boards);
+    bench_make_move(boards);
+    bench_evaluate(boards);
+    bench_hashing(boards);
+    bench_pages(TT_PAGES_HUGE, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    bench_pages(TT_PAGES_NORMAL, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    bench_history();
+    bench_search(boards, depth, disabled, print_stats);
+    return 0;
+}
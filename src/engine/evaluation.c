@@ -0,0 +1,90 @@
+#include "evaluation.h"
+#include "bitboard.h"
+#include "tablebase.h"
+
+const int piece_value[6] = {100, 320, 330, 500, 900, 0};
+
+// The king is worth more than any exchange so that it only ever recaptures last
+static const int see_value[6] = {100, 320, 330, 500, 900, 20000};
+
+// Static evaluation from the point of view of the side to move
+int evaluate(const board *b)
+{
+    int dtm;
+    switch (tb_probe(b, &dtm))
+    {
+    case TB_WIN:
+        return TB_WIN_SCORE - dtm;
+    case TB_LOSS:
+        return -TB_WIN_SCORE + dtm;
+    case TB_DRAW:
+        return 0;
+    default:
+        break;
+    }
+
+    int score = 0;
+    for (enum piece p = PAWN; p < KING; p++)
+    {
+        score += piece_value[p] * (pop_count(b->piece_bb[p][WHITE]) - pop_count(b->piece_bb[p][BLACK]));
+    }
+
+    return b->side_to_move == WHITE ? score : -score;
+}
+
+// Static exchange evaluation: material won by the side to move when both sides keep
+// recapturing on the target square with their least valuable attacker, x-rays included
+int see(const board *b, move m)
+{
+    enum square from = move_from(m);
+    enum square to = move_to(m);
+    enum color side = b->side_to_move;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+    bitboard bishops_queens = b->piece_bb[BISHOP][WHITE] | b->piece_bb[BISHOP][BLACK] |
+                              b->piece_bb[QUEEN][WHITE] | b->piece_bb[QUEEN][BLACK];
+    bitboard rooks_queens = b->piece_bb[ROOK][WHITE] | b->piece_bb[ROOK][BLACK] |
+                            b->piece_bb[QUEEN][WHITE] | b->piece_bb[QUEEN][BLACK];
+    int gain[32];
+    int d = 0;
+
+    if (move_flag(m) == MOVE_CASTLING)
+        return 0;
+
+    enum piece attacker = board_get_piece_at(b, from);
+    enum piece victim = board_get_piece_at(b, to);
+    gain[0] = move_flag(m) == MOVE_EN_PASSANT ? see_value[PAWN] : victim == NO_PIECE ? 0 : see_value[victim];
+    if (move_flag(m) == MOVE_PROMOTION)
+    {
+        gain[0] += see_value[move_promotion(m)] - see_value[PAWN];
+        attacker = move_promotion(m);
+    }
+
+    occupied ^= 1ULL << from;
+    if (move_flag(m) == MOVE_EN_PASSANT)
+        occupied ^= 1ULL << (side == WHITE ? to - 8 : to + 8);
+
+    bitboard attackers = board_attackers_to(b, to, occupied) & occupied;
+    while (d < 31)
+    {
+        side = side == WHITE ? BLACK : WHITE;
+        bitboard own = attackers & b->all_pieces[side];
+        if (!own)
+            break;
+
+        d++;
+        gain[d] = see_value[attacker] - gain[d - 1];
+
+        for (attacker = PAWN; !(own & b->piece_bb[attacker][side]); attacker++)
+            ;
+        occupied ^= 1ULL << lsb(own & b->piece_bb[attacker][side]);
+        attackers |= (bishop_attacks(to, occupied) & bishops_queens) | (rook_attacks(to, occupied) & rooks_queens);
+        attackers &= occupied;
+    }
+
+    while (d > 0)
+    {
+        gain[d - 1] = -(-gain[d - 1] > gain[d] ? -gain[d - 1] : gain[d]);
+        d--;
+    }
+    return gain[0];
+}
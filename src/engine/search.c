@@ -0,0 +1,630 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "search.h"
+#include "bitboard.h"
+#include "evaluation.h"
+#include "move_generator.h"
+#include "platform.h"
+#include "tablebase.h"
+#include "zobrist.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define INFINITE_SCORE 32767
+#define DRAW_SCORE 0
+
+#define DELTA_MARGIN 200 // positional swing a single capture is assumed not to exceed
+
+#define REVERSE_FUTILITY_DEPTH 6
+#define REVERSE_FUTILITY_MARGIN 80 // per ply of remaining depth
+#define FUTILITY_DEPTH 3
+#define FUTILITY_MARGIN 120 // per ply of remaining depth
+#define LATE_MOVE_DEPTH 4
+#define NULL_VERIFY_DEPTH 12 // null move cutoffs are verified from here on whatever the material
+
+// Late move reductions by remaining depth and move number
+static int lmr_table[64][64];
+
+#define CUCKOO_SIZE 8192
+
+// Every reversible piece move, keyed by the zobrist difference it makes
+static bitboard cuckoo_keys[CUCKOO_SIZE];
+static move cuckoo_moves[CUCKOO_SIZE];
+
+static int cuckoo_h1(bitboard key) { return key & (CUCKOO_SIZE - 1); }
+static int cuckoo_h2(bitboard key) { return (key >> 16) & (CUCKOO_SIZE - 1); }
+
+static void cuckoo_init(void)
+{
+    zobrist_init();
+
+    for (enum piece p = KNIGHT; p <= KING; p++)
+    {
+        for (enum color c = WHITE; c <= BLACK; c++)
+        {
+            for (enum square s1 = A1; s1 <= H8; s1++)
+            {
+                bitboard targets = p == KNIGHT ? knight_attacks(s1) : p == BISHOP ? bishop_attacks(s1, 0)
+                                                                   : p == ROOK     ? rook_attacks(s1, 0)
+                                                                   : p == QUEEN    ? queen_attacks(s1, 0)
+                                                                                   : king_attacks(s1);
+                for (enum square s2 = s1 + 1; s2 <= H8; s2++)
+                {
+                    if (!(targets & (1ULL << s2)))
+                        continue;
+
+                    move m = move_encode(s1, s2, MOVE_NORMAL, NO_PIECE);
+                    bitboard key = zobrist_piece[p][c][s1] ^ zobrist_piece[p][c][s2] ^ zobrist_side;
+                    int i = cuckoo_h1(key);
+                    for (;;)
+                    {
+                        bitboard displaced_key = cuckoo_keys[i];
+                        move displaced_move = cuckoo_moves[i];
+                        cuckoo_keys[i] = key;
+                        cuckoo_moves[i] = m;
+                        if (displaced_move == MOVE_NONE)
+                            break;
+                        key = displaced_key;
+                        m = displaced_move;
+                        i = i == cuckoo_h1(key) ? cuckoo_h2(key) : cuckoo_h1(key);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void lmr_init(void)
+{
+    for (int depth = 1; depth < 64; depth++)
+    {
+        for (int moves = 1; moves < 64; moves++)
+            lmr_table[depth][moves] = (int)(0.75 + log(depth) * log(moves) / 2.25);
+    }
+}
+
+// Shared tables, built once whichever thread gets here first
+static void search_tables_init(void)
+{
+    cuckoo_init();
+    lmr_init();
+}
+
+void search_init(search_thread *t, tt_table *tt)
+{
+    static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&tables_once, search_tables_init);
+    t->tt = tt;
+    t->key_count = 0;
+    t->nodes = 0;
+    t->stop = 0;
+    t->best_move = MOVE_NONE;
+}
+
+void search_push_history(search_thread *t, bitboard key)
+{
+    // Only the reversible tail matters, keep the most recent positions
+    if (t->key_count == MAX_HISTORY)
+    {
+        for (int i = 1; i < MAX_HISTORY; i++)
+            t->keys[i - 1] = t->keys[i];
+        t->key_count--;
+    }
+    t->keys[t->key_count++] = key;
+}
+
+// Earlier positions with the same side to move, back to the last irreversible move. One
+// occurrence inside the search tree is enough, from the root back it takes two, a real
+// threefold repetition
+static int is_repetition(const search_thread *t, const board *b, int ply)
+{
+    int end = b->halfmove_clock < t->key_count ? b->halfmove_clock : t->key_count;
+    int before_root = 0;
+
+    for (int i = 4; i <= end; i += 2)
+    {
+        if (t->keys[t->key_count - i] == b->key && (i < ply || ++before_root == 2))
+            return 1;
+    }
+    return 0;
+}
+
+// Whether the side to move can reach a position already on the search path with one
+// reversible move, in which case the draw is available one ply before it shows up
+static int has_upcoming_repetition(const search_thread *t, const board *b, int ply)
+{
+    int end = b->halfmove_clock < t->key_count ? b->halfmove_clock : t->key_count;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+
+    for (int i = 3; i <= end && i < ply; i += 2)
+    {
+        bitboard move_key = b->key ^ t->keys[t->key_count - i];
+        int j = cuckoo_h1(move_key);
+        if (cuckoo_keys[j] != move_key)
+        {
+            j = cuckoo_h2(move_key);
+            if (cuckoo_keys[j] != move_key)
+                continue;
+        }
+
+        if (!(between_squares(move_from(cuckoo_moves[j]), move_to(cuckoo_moves[j])) & occupied))
+            return 1;
+    }
+    return 0;
+}
+
+static int score_to_tt(int score, int ply)
+{
+    return score >= MATE_BOUND ? score + ply : score <= -MATE_BOUND ? score - ply : score;
+}
+
+static int score_from_tt(int score, int ply)
+{
+    return score >= MATE_BOUND ? score - ply : score <= -MATE_BOUND ? score + ply : score;
+}
+
+// Hash move first, then captures by most valuable victim and least valuable attacker
+static void score_moves(const board *b, const move_list *list, int *scores, move tt_move)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        move m = list->moves[i];
+        enum piece victim = move_flag(m) == MOVE_EN_PASSANT ? PAWN : board_get_piece_at(b, move_to(m));
+
+        if (m == tt_move)
+            scores[i] = 1 << 20;
+        else if (victim != NO_PIECE)
+            scores[i] = (1 << 16) + 16 * piece_value[victim] - board_get_piece_at(b, move_from(m));
+        else if (move_flag(m) == MOVE_PROMOTION)
+            scores[i] = (1 << 15) + piece_value[move_promotion(m)];
+        else
+            scores[i] = 0;
+    }
+}
+
+static move pick_move(move_list *list, int *scores, int index)
+{
+    int best = index;
+    for (int i = index + 1; i < list->count; i++)
+    {
+        if (scores[i] > scores[best])
+            best = i;
+    }
+
+    move m = list->moves[best];
+    int score = scores[best];
+    list->moves[best] = list->moves[index];
+    scores[best] = scores[index];
+    list->moves[index] = m;
+    scores[index] = score;
+    return m;
+}
+
+static int evaluate_node(search_thread *t, const board *b)
+{
+    STATS_TIMER_START(start);
+    int score = evaluate(b);
+    STATS_TIMER_STOP(t, STATS_EVAL, start);
+    (void)t;
+    return score;
+}
+
+static void check_time(search_thread *t)
+{
+    if (t->limits.time_ms && platform_ms() - t->start_time >= t->limits.time_ms)
+        t->stop = 1;
+}
+
+// Captures and promotions until the position is quiet, every evasion when in check
+static int quiescence(search_thread *t, const board *b, int alpha, int beta, int ply)
+{
+    t->nodes++;
+    STATS_INC(t, nodes);
+    STATS_INC(t, qnodes);
+    STATS_PLY(t, ply);
+    if ((t->nodes & 2047) == 0)
+        check_time(t);
+    if (t->stop)
+        return 0;
+
+    if (b->halfmove_clock >= 100 || is_repetition(t, b, ply))
+        return DRAW_SCORE;
+    if (ply >= MAX_PLY - 1)
+        return evaluate_node(t, b);
+
+    tt_entry entry;
+    move tt_move = MOVE_NONE;
+    STATS_INC(t, tt_probes);
+    if (tt_probe(t->tt, b->key, &entry))
+    {
+        STATS_INC(t, tt_hits);
+        int score = score_from_tt(entry.score, ply);
+        tt_move = entry.best_move;
+        if (entry.bound == TT_EXACT || (entry.bound == TT_LOWER && score >= beta) ||
+            (entry.bound == TT_UPPER && score <= alpha))
+            return score;
+    }
+
+    int checked = in_check(b);
+    int original_alpha = alpha;
+    int best_score = -INFINITE_SCORE;
+    int stand_pat = 0;
+
+    // Standing pat is not an option when in check
+    if (!checked)
+    {
+        stand_pat = evaluate_node(t, b);
+        if (stand_pat >= beta)
+            return stand_pat;
+        if (stand_pat > alpha)
+            alpha = stand_pat;
+        best_score = stand_pat;
+    }
+
+    move_list list;
+    int scores[MAX_MOVES];
+    STATS_TIMER_START(movegen_start);
+    if (checked)
+        generate_evasions(b, &list);
+    else
+        generate_captures(b, &list);
+    STATS_TIMER_STOP(t, STATS_MOVEGEN, movegen_start);
+    score_moves(b, &list, scores, tt_move);
+
+    int legal = 0;
+    move best_move = MOVE_NONE;
+
+    t->keys[t->key_count++] = b->key;
+    for (int i = 0; i < list.count; i++)
+    {
+        move m = pick_move(&list, scores, i);
+        if (!is_legal(b, m))
+            continue;
+        legal++;
+
+        if (!checked)
+        {
+            // Delta pruning: even winning the piece for free would not reach alpha
+            enum piece victim = move_flag(m) == MOVE_EN_PASSANT ? PAWN : board_get_piece_at(b, move_to(m));
+            int gain = (victim == NO_PIECE ? 0 : piece_value[victim]) +
+                       (move_flag(m) == MOVE_PROMOTION ? piece_value[move_promotion(m)] - piece_value[PAWN] : 0);
+            if (stand_pat + gain + DELTA_MARGIN <= alpha)
+                continue;
+
+            // SEE pruning: the exchange loses material
+            if (see(b, m) < 0)
+                continue;
+        }
+
+        board child = *b;
+        board_make_move(&child, m);
+        int score = -quiescence(t, &child, -beta, -alpha, ply + 1);
+        if (t->stop)
+            break;
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best_move = m;
+            if (score > alpha)
+            {
+                alpha = score;
+                if (alpha >= beta)
+                {
+                    STATS_CUTOFF(t, legal - 1);
+                    break;
+                }
+            }
+        }
+    }
+    t->key_count--;
+
+    if (t->stop)
+        return 0;
+
+    if (checked && legal == 0)
+        return -MATE_SCORE + ply;
+
+    enum tt_bound bound = best_score >= beta ? TT_LOWER : best_score > original_alpha ? TT_EXACT : TT_UPPER;
+    tt_store(t->tt, b->key, best_move, score_to_tt(best_score, ply), 0, bound);
+    return best_score;
+}
+
+static int alpha_beta(search_thread *t, const board *b, int alpha, int beta, int depth, int ply, int null_allowed)
+{
+    if (depth <= 0)
+        return quiescence(t, b, alpha, beta, ply);
+
+    t->nodes++;
+    STATS_INC(t, nodes);
+    STATS_PLY(t, ply);
+    if ((t->nodes & 2047) == 0)
+        check_time(t);
+    if (t->stop)
+        return 0;
+
+    if (ply > 0)
+    {
+        if (b->halfmove_clock >= 100 || is_repetition(t, b, ply))
+            return DRAW_SCORE;
+
+        if (alpha < DRAW_SCORE && has_upcoming_repetition(t, b, ply))
+        {
+            alpha = DRAW_SCORE;
+            if (alpha >= beta)
+                return alpha;
+        }
+
+        // Tablebase distances are exact, so they become mate scores from here
+        int dtm;
+        switch (tb_probe(b, &dtm))
+        {
+        case TB_WIN:
+            return MATE_SCORE - ply - dtm;
+        case TB_LOSS:
+            return -MATE_SCORE + ply + dtm;
+        case TB_DRAW:
+            return DRAW_SCORE;
+        default:
+            break;
+        }
+
+        if (ply >= MAX_PLY - 1)
+            return evaluate_node(t, b);
+    }
+
+    tt_entry entry;
+    move tt_move = MOVE_NONE;
+    STATS_INC(t, tt_probes);
+    if (tt_probe(t->tt, b->key, &entry))
+    {
+        STATS_INC(t, tt_hits);
+        int score = score_from_tt(entry.score, ply);
+        tt_move = entry.best_move;
+        if (ply > 0 && entry.depth >= depth &&
+            (entry.bound == TT_EXACT || (entry.bound == TT_LOWER && score >= beta) ||
+             (entry.bound == TT_UPPER && score <= alpha)))
+            return score;
+    }
+
+    int pv_node = beta - alpha > 1;
+    int checked = in_check(b);
+    int static_eval = checked ? -INFINITE_SCORE : evaluate_node(t, b);
+
+    if (!pv_node && !checked && ply > 0)
+    {
+        // Reverse futility pruning: far enough above beta that a shallow search will not come back
+        if (!(t->limits.disabled & SEARCH_REVERSE_FUTILITY) && depth <= REVERSE_FUTILITY_DEPTH &&
+            beta < MATE_BOUND && static_eval - REVERSE_FUTILITY_MARGIN * depth >= beta)
+            return static_eval;
+
+        // Null move pruning, with a reduction growing with depth and the margin over beta
+        enum color us = b->side_to_move;
+        bitboard pieces = b->piece_bb[KNIGHT][us] | b->piece_bb[BISHOP][us] | b->piece_bb[ROOK][us] | b->piece_bb[QUEEN][us];
+        if (!(t->limits.disabled & SEARCH_NULL_MOVE) && null_allowed && depth >= 2 && static_eval >= beta && pieces)
+        {
+            int margin = (static_eval - beta) / 200;
+            int reduction = 2 + depth / 4 + (margin < 2 ? margin : 2);
+            int null_depth = depth - 1 - reduction;
+
+            board child = *b;
+            board_make_null_move(&child);
+            STATS_INC(t, null_attempts);
+
+            t->keys[t->key_count++] = b->key;
+            int score = -alpha_beta(t, &child, -beta, -beta + 1, null_depth, ply + 1, 0);
+            t->key_count--;
+            if (t->stop)
+                return 0;
+
+            if (score >= beta)
+            {
+                if (score >= MATE_BOUND)
+                    score = beta;
+
+                // A single piece besides pawns is where zugzwang lives, check with a real search
+                if ((pieces & (pieces - 1)) && depth < NULL_VERIFY_DEPTH)
+                    return score;
+
+                STATS_INC(t, null_researches);
+                int verified = alpha_beta(t, b, beta - 1, beta, null_depth, ply, 0);
+                if (t->stop)
+                    return 0;
+                if (verified >= beta)
+                    return score;
+            }
+        }
+    }
+
+    move_list list;
+    int scores[MAX_MOVES];
+    STATS_TIMER_START(movegen_start);
+    generate_moves(b, &list);
+    STATS_TIMER_STOP(t, STATS_MOVEGEN, movegen_start);
+    score_moves(b, &list, scores, tt_move);
+
+    int original_alpha = alpha;
+    int best_score = -INFINITE_SCORE;
+    int legal = 0;
+    move best_move = MOVE_NONE;
+
+    t->keys[t->key_count++] = b->key;
+    for (int i = 0; i < list.count; i++)
+    {
+        move m = pick_move(&list, scores, i);
+        if (!is_legal(b, m))
+            continue;
+        legal++;
+
+        int quiet = move_flag(m) == MOVE_NORMAL || move_flag(m) == MOVE_CASTLING;
+        quiet = quiet && board_get_piece_at(b, move_to(m)) == NO_PIECE;
+
+        // Quiet moves that cannot matter, once a move has been searched; the depth goes first so
+        // that deeper nodes never pay for gives_check
+        if (!pv_node && !checked && quiet && (depth <= LATE_MOVE_DEPTH || depth <= FUTILITY_DEPTH) &&
+            best_score > -MATE_BOUND && !gives_check(b, m))
+        {
+            if (!(t->limits.disabled & SEARCH_LATE_MOVE_PRUNING) && depth <= LATE_MOVE_DEPTH &&
+                legal > 3 + depth * depth)
+                continue;
+
+            if (!(t->limits.disabled & SEARCH_FUTILITY) && depth <= FUTILITY_DEPTH &&
+                static_eval + FUTILITY_MARGIN * depth <= alpha)
+                continue;
+        }
+
+        board child = *b;
+        board_make_move(&child, m);
+
+        int score;
+        if (legal == 1)
+        {
+            score = -alpha_beta(t, &child, -beta, -alpha, depth - 1, ply + 1, 1);
+        }
+        else
+        {
+            // Late move reductions, then a zero window search that is widened when it fails high
+            int reduction = 0;
+            if (!(t->limits.disabled & SEARCH_LMR) && depth >= 3 && quiet && !checked && !child.checkers &&
+                legal > (pv_node ? 3 : 1))
+            {
+                reduction = lmr_table[depth < 64 ? depth : 63][legal < 64 ? legal : 63] - pv_node;
+                reduction = reduction < 0 ? 0 : reduction > depth - 2 ? depth - 2 : reduction;
+            }
+
+            if (reduction)
+                STATS_INC(t, lmr_attempts);
+            score = -alpha_beta(t, &child, -alpha - 1, -alpha, depth - 1 - reduction, ply + 1, 1);
+
+            if (reduction && score > alpha)
+            {
+                STATS_INC(t, lmr_researches);
+                score = -alpha_beta(t, &child, -alpha - 1, -alpha, depth - 1, ply + 1, 1);
+            }
+            if (pv_node && score > alpha && score < beta)
+                score = -alpha_beta(t, &child, -beta, -alpha, depth - 1, ply + 1, 1);
+        }
+        if (t->stop)
+            break;
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best_move = m;
+            if (score > alpha)
+            {
+                alpha = score;
+                if (alpha >= beta)
+                {
+                    STATS_CUTOFF(t, legal - 1);
+                    break;
+                }
+            }
+        }
+    }
+    t->key_count--;
+
+    if (t->stop)
+        return 0;
+
+    if (legal == 0)
+        return checked ? -MATE_SCORE + ply : DRAW_SCORE;
+
+    enum tt_bound bound = best_score >= beta ? TT_LOWER : best_score > original_alpha ? TT_EXACT : TT_UPPER;
+    tt_store(t->tt, b->key, best_move, score_to_tt(best_score, ply), depth, bound);
+
+    if (ply == 0)
+        t->root_move = best_move;
+    return best_score;
+}
+
+static void print_info(const search_thread *t)
+{
+    char move_str[6];
+    double elapsed = platform_ms() - t->start_time;
+
+    move_to_string(t->best_move, move_str);
+    printf("info depth %d ", t->depth);
+    int mate;
+    if (search_mate_moves(t->score, &mate))
+        printf("score mate %d ", mate);
+    else
+        printf("score cp %d ", t->score);
+    printf("nodes %llu nps %llu time %.0f pv %s\n", t->nodes,
+           (unsigned long long)(t->nodes * 1000.0 / (elapsed > 1 ? elapsed : 1)), elapsed, move_str);
+    fflush(stdout);
+}
+
+// Iterative deepening, returns the best move of the last completed iteration
+move search(search_thread *t, const board *b, const search_limits *limits)
+{
+    t->limits = *limits;
+    t->start_time = platform_ms();
+    t->stop = 0;
+    t->nodes = 0;
+    t->best_move = MOVE_NONE;
+    t->score = 0;
+    t->depth = 0;
+#ifdef SEARCH_STATS
+    memset(&t->stats, 0, sizeof(t->stats));
+#endif
+    STATS_TIMER_START(search_start);
+
+    for (int depth = 1; depth <= limits->depth && depth < MAX_PLY; depth++)
+    {
+        t->root_move = MOVE_NONE;
+        int score = alpha_beta(t, b, -INFINITE_SCORE, INFINITE_SCORE, depth, 0, 0);
+        if (t->stop)
+            break;
+
+        t->best_move = t->root_move;
+        t->score = score;
+        t->depth = depth;
+        if (limits->print_info)
+            print_info(t);
+    }
+
+    STATS_TIMER_STOP(t, STATS_TOTAL, search_start);
+#ifdef SEARCH_STATS
+    if (limits->print_stats)
+        stats_print_json(&t->stats, t->depth, stderr);
+#endif
+    return t->best_move;
+}
+
+// Whether a score is a mate score, moves is then the signed number of moves to mate, negative
+// when the side to move gets mated and 0 when it already is
+int search_mate_moves(int score, int *moves)
+{
+    if (score >= MATE_BOUND)
+        *moves = (MATE_SCORE - score + 1) / 2;
+    else if (score <= -MATE_BOUND)
+        *moves = -((MATE_SCORE + score) / 2);
+    else
+        return 0;
+    return 1;
+}
+
+// Flag of a technique by its command line name, 0 if unknown
+int search_technique(const char *name)
+{
+    static const struct
+    {
+        const char *name;
+        int flag;
+    } techniques[] = {{"null", SEARCH_NULL_MOVE},
+                      {"lmr", SEARCH_LMR},
+                      {"rfp", SEARCH_REVERSE_FUTILITY},
+                      {"futility", SEARCH_FUTILITY},
+                      {"lmp", SEARCH_LATE_MOVE_PRUNING}};
+
+    for (size_t i = 0; i < sizeof(techniques) / sizeof(techniques[0]); i++)
+    {
+        if (strcmp(techniques[i].name, name) == 0)
+            return techniques[i].flag;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+static void print_array(const unsigned long long *values, int count, FILE *out)
+{
+    fputc('[', out);
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(out, i ? ",%llu" : "%llu", values[i]);
+    }
+    fputc(']', out);
+}
+
+// One JSON object per line, the per-ply node histogram trimmed after the deepest ply reached
+void stats_print_json(const search_stats *stats, int depth, FILE *out)
+{
+    int plies = STATS_MAX_PLY;
+    while (plies > 0 && stats->ply_nodes[plies - 1] == 0)
+    {
+        plies--;
+    }
+
+    unsigned long long other = stats->time_ns[STATS_TOTAL] - stats->time_ns[STATS_MOVEGEN] - stats->time_ns[STATS_EVAL];
+
+    // Searches on other threads may dump at the same time, the line stays whole
+    flockfile(out);
+    fprintf(out, "{\"depth\":%d,\"nodes\":%llu,\"qnodes\":%llu,\"tt_probes\":%llu,\"tt_hits\":%llu,\"cutoffs\":",
+            depth, stats->nodes, stats->qnodes, stats->tt_probes, stats->tt_hits);
+    print_array(stats->cutoffs, STATS_MOVE_INDEXES, out);
+    fprintf(out, ",\"null_move\":{\"attempts\":%llu,\"researches\":%llu}", stats->null_attempts, stats->null_researches);
+    fprintf(out, ",\"lmr\":{\"attempts\":%llu,\"researches\":%llu}", stats->lmr_attempts, stats->lmr_researches);
+    fprintf(out, ",\"time_ms\":{\"total\":%.3f,\"movegen\":%.3f,\"eval\":%.3f,\"search\":%.3f}",
+            stats->time_ns[STATS_TOTAL] / 1e6, stats->time_ns[STATS_MOVEGEN] / 1e6,
+            stats->time_ns[STATS_EVAL] / 1e6, other / 1e6);
+    fprintf(out, ",\"depth_histogram\":");
+    print_array(stats->ply_nodes, plies, out);
+    fprintf(out, "}\n");
+    fflush(out);
+    funlockfile(out);
+}
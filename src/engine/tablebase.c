@@ -0,0 +1,1033 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tablebase.h"
+#include "bitboard.h"
+#include "platform.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TB_MAGIC "MCTB0001"
+#define TB_MAX_TABLES 128
+#define TB_MAX_MOVES 128
+#define TB_MAX_DTM 254
+
+#define KK_PAWNLESS 462 // white king in a1-d1-d4, black king below the diagonal when white's is on it
+#define KK_PAWNS 1806   // white king on files a-d
+
+// Generation state of a position, also the 2-bit code stored in the WDL tables
+#define TB_UNKNOWN TB_DRAW
+#define TB_ILLEGAL 3
+
+typedef struct
+{
+    int count;                        // number of pieces, kings included
+    enum piece piece[TB_MAX_PIECES];  // slot 0 is the white king, slot 1 the black king
+    enum color color[TB_MAX_PIECES];
+    int sq[TB_MAX_PIECES];
+    enum color side_to_move;
+} tb_position;
+
+typedef struct
+{
+    char name[8];
+    int count;
+    int has_pawns;
+    enum piece piece[TB_MAX_PIECES];
+    enum color color[TB_MAX_PIECES];
+    unsigned long long size;         // positions per side to move
+    const unsigned char *wdl[2];     // 2 bits per position
+    const unsigned char *dtm[2];     // plies to mate, 0 for draws
+    int max_dtm;
+    void *mapping;
+    size_t mapping_size;
+} tb_table;
+
+typedef struct
+{
+    char magic[8];
+    char name[8];
+    unsigned long long size;
+    unsigned int max_dtm;
+    unsigned int reserved[9];
+} tb_file_header;
+
+typedef struct
+{
+    tb_table *table;
+    unsigned char *state[2];
+    unsigned char *dtm[2];
+    unsigned char *wake[2]; // pass at which a position has to be looked at again
+    int pass;
+} tb_generator;
+
+enum tb_phase
+{
+    TB_PHASE_EVALUATE,
+    TB_PHASE_MARK
+};
+
+typedef struct
+{
+    tb_generator *gen;
+    enum tb_phase phase;
+    enum color side;
+    unsigned long long begin;
+    unsigned long long end;
+    unsigned long long changes;
+    int max_wake;
+} tb_worker;
+
+static tb_table tables[TB_MAX_TABLES];
+static int table_count;
+
+static int kk_ready;
+static int kk_index[2][64][64];
+static int kk_squares[2][KK_PAWNS][2];
+static int kk_count[2];
+
+static const char piece_chars[] = "PNBRQK";
+static const int piece_values[] = {1, 3, 3, 5, 9, 0};
+
+static int flip_h(int sq) { return sq ^ 7; }
+static int flip_v(int sq) { return sq ^ 56; }
+static int flip_d(int sq) { return ((sq & 7) << 3) | (sq >> 3); }
+
+static void tb_init_kk(void)
+{
+    if (kk_ready)
+        return;
+
+    for (int pawns = 0; pawns < 2; pawns++)
+    {
+        int count = 0;
+        for (int wk = 0; wk < 64; wk++)
+        {
+            for (int bk = 0; bk < 64; bk++)
+                kk_index[pawns][wk][bk] = -1;
+        }
+
+        for (int wk = 0; wk < 64; wk++)
+        {
+            int file = wk & 7, rank = wk >> 3;
+            if (file > 3 || (!pawns && rank > file))
+                continue;
+
+            for (int bk = 0; bk < 64; bk++)
+            {
+                if (bk == wk || (king_attacks(wk) & (1ULL << bk)))
+                    continue;
+                if (!pawns && rank == file && (bk >> 3) > (bk & 7))
+                    continue;
+
+                kk_index[pawns][wk][bk] = count;
+                kk_squares[pawns][count][0] = wk;
+                kk_squares[pawns][count][1] = bk;
+                count++;
+            }
+        }
+        kk_count[pawns] = count;
+    }
+
+    kk_ready = 1;
+}
+
+static bitboard tb_piece_attacks(enum piece p, enum color c, int sq, bitboard occupied)
+{
+    switch (p)
+    {
+    case PAWN:
+        return pawn_attacks(c, sq);
+    case KNIGHT:
+        return knight_attacks(sq);
+    case BISHOP:
+        return bishop_attacks(sq, occupied);
+    case ROOK:
+        return rook_attacks(sq, occupied);
+    case QUEEN:
+        return queen_attacks(sq, occupied);
+    default:
+        return king_attacks(sq);
+    }
+}
+
+static bitboard tb_occupied(const tb_position *p)
+{
+    bitboard occupied = 0;
+    for (int i = 0; i < p->count; i++)
+        occupied |= 1ULL << p->sq[i];
+    return occupied;
+}
+
+static int tb_in_check(const tb_position *p, enum color c)
+{
+    bitboard occupied = tb_occupied(p);
+    int king = -1;
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->piece[i] == KING && p->color[i] == c)
+            king = p->sq[i];
+    }
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->color[i] != c && (tb_piece_attacks(p->piece[i], p->color[i], p->sq[i], occupied) & (1ULL << king)))
+            return 1;
+    }
+    return 0;
+}
+
+static int tb_is_legal(const tb_position *p)
+{
+    bitboard occupied = tb_occupied(p);
+    if (pop_count(occupied) != p->count)
+        return 0;
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->piece[i] == PAWN && (p->sq[i] < A2 || p->sq[i] > H7))
+            return 0;
+    }
+
+    return !tb_in_check(p, !p->side_to_move);
+}
+
+// Name of one side's material, the king first and the rest by descending value
+static void tb_side_name(const enum piece *pieces, int count, char *name)
+{
+    *name++ = 'K';
+    for (int p = QUEEN; p >= PAWN; p--)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (pieces[i] == (enum piece)p)
+                *name++ = piece_chars[p];
+        }
+    }
+    *name = '\0';
+}
+
+static int tb_side_value(const char *name)
+{
+    int value = 0;
+    for (; *name; name++)
+        value += piece_values[strchr(piece_chars, *name) - piece_chars];
+    return value;
+}
+
+// Tables are stored with the stronger side as white
+static int tb_is_canonical(const char *white, const char *black)
+{
+    int w = tb_side_value(white), b = tb_side_value(black);
+    return w > b || (w == b && strcmp(white, black) >= 0);
+}
+
+static void tb_material_name(const tb_position *p, char *name, int *flipped)
+{
+    enum piece pieces[2][TB_MAX_PIECES];
+    int counts[2] = {0, 0};
+    char white[8], black[8];
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->piece[i] != KING)
+            pieces[p->color[i]][counts[p->color[i]]++] = p->piece[i];
+    }
+
+    tb_side_name(pieces[WHITE], counts[WHITE], white);
+    tb_side_name(pieces[BLACK], counts[BLACK], black);
+
+    *flipped = !tb_is_canonical(white, black);
+    strcpy(name, *flipped ? black : white);
+    strcat(name, *flipped ? white : black);
+}
+
+static tb_table *tb_find(const char *name)
+{
+    for (int i = 0; i < table_count; i++)
+    {
+        if (strcmp(tables[i].name, name) == 0)
+            return &tables[i];
+    }
+    return NULL;
+}
+
+// Parses an ending such as "KBNK" into a table layout, returns 0 on bad input
+static int tb_layout(tb_table *t, const char *ending)
+{
+    tb_position p;
+    int side = -1, flipped;
+
+    memset(t, 0, sizeof(tb_table));
+    p.count = 0;
+
+    for (; *ending; ending++)
+    {
+        const char *c = strchr(piece_chars, *ending);
+        if (!c || p.count == TB_MAX_PIECES)
+            return 0;
+        if (*c == 'K')
+            side++;
+        if (side < 0 || side > 1)
+            return 0;
+        p.piece[p.count] = (enum piece)(c - piece_chars);
+        p.color[p.count] = (enum color)side;
+        p.count++;
+    }
+
+    if (side != 1 || p.count < 3)
+        return 0;
+
+    tb_material_name(&p, t->name, &flipped);
+    t->count = p.count;
+    t->piece[0] = KING;
+    t->color[0] = WHITE;
+    t->piece[1] = KING;
+    t->color[1] = BLACK;
+
+    int slot = 2;
+    side = -1;
+    for (const char *c = t->name; *c; c++)
+    {
+        if (*c == 'K')
+        {
+            side++;
+            continue;
+        }
+        t->piece[slot] = (enum piece)(strchr(piece_chars, *c) - piece_chars);
+        t->color[slot] = (enum color)side;
+        t->has_pawns |= t->piece[slot] == PAWN;
+        slot++;
+    }
+
+    tb_init_kk();
+    t->size = kk_count[t->has_pawns];
+    for (int i = 2; i < t->count; i++)
+        t->size *= 64;
+
+    return 1;
+}
+
+static void tb_canonicalise(const tb_table *t, int *sq)
+{
+    int transform = 0;
+
+    if ((sq[0] & 7) > 3)
+        transform |= 1;
+    if (!t->has_pawns)
+    {
+        int king = (transform & 1) ? flip_h(sq[0]) : sq[0];
+        if ((king >> 3) > 3)
+        {
+            transform |= 2;
+            king = flip_v(king);
+        }
+        if ((king >> 3) > (king & 7))
+            transform |= 4;
+        else if ((king >> 3) == (king & 7))
+        {
+            int other = sq[1];
+            if (transform & 1)
+                other = flip_h(other);
+            if (transform & 2)
+                other = flip_v(other);
+            if ((other >> 3) > (other & 7))
+                transform |= 4;
+        }
+    }
+
+    for (int i = 0; i < t->count; i++)
+    {
+        if (transform & 1)
+            sq[i] = flip_h(sq[i]);
+        if (transform & 2)
+            sq[i] = flip_v(sq[i]);
+        if (transform & 4)
+            sq[i] = flip_d(sq[i]);
+    }
+}
+
+static long long tb_index(const tb_table *t, const int *squares)
+{
+    int sq[TB_MAX_PIECES];
+    memcpy(sq, squares, sizeof(int) * t->count);
+    tb_canonicalise(t, sq);
+
+    long long index = kk_index[t->has_pawns][sq[0]][sq[1]];
+    if (index < 0)
+        return -1;
+    for (int i = 2; i < t->count; i++)
+        index = index * 64 + sq[i];
+    return index;
+}
+
+static void tb_decode(const tb_table *t, unsigned long long index, enum color side, tb_position *p)
+{
+    p->count = t->count;
+    p->side_to_move = side;
+    for (int i = t->count - 1; i >= 2; i--)
+    {
+        p->sq[i] = index % 64;
+        index /= 64;
+    }
+    p->sq[0] = kk_squares[t->has_pawns][index][0];
+    p->sq[1] = kk_squares[t->has_pawns][index][1];
+    memcpy(p->piece, t->piece, sizeof(t->piece));
+    memcpy(p->color, t->color, sizeof(t->color));
+}
+
+static int tb_read(const tb_table *t, enum color side, long long index, int *dtm)
+{
+    *dtm = t->dtm[side][index];
+    return (t->wdl[side][index >> 2] >> ((index & 3) * 2)) & 3;
+}
+
+// Probes a finished table for an arbitrary position, pieces in any order
+static int tb_probe_position(const tb_position *p, int *dtm)
+{
+    char name[8];
+    int flipped, sq[TB_MAX_PIECES], used = 0;
+
+    *dtm = 0;
+    if (p->count == 2)
+        return TB_DRAW;
+
+    tb_material_name(p, name, &flipped);
+    tb_table *t = tb_find(name);
+    if (!t)
+        return TB_NONE;
+
+    for (int slot = 0; slot < t->count; slot++)
+    {
+        enum color c = flipped ? !t->color[slot] : t->color[slot];
+        for (int i = 0; i < p->count; i++)
+        {
+            if (!(used & (1 << i)) && p->piece[i] == t->piece[slot] && p->color[i] == c)
+            {
+                used |= 1 << i;
+                sq[slot] = flipped ? flip_v(p->sq[i]) : p->sq[i];
+                break;
+            }
+        }
+    }
+
+    long long index = tb_index(t, sq);
+    if (index < 0)
+        return TB_NONE;
+
+    int result = tb_read(t, flipped ? !p->side_to_move : p->side_to_move, index, dtm);
+    return result == TB_ILLEGAL ? TB_NONE : result;
+}
+
+static void tb_add_child(const tb_position *p, tb_position *children, int *same, int *count,
+                         int slot, int to, enum piece promotion)
+{
+    tb_position *child = &children[*count];
+    *child = *p;
+    child->side_to_move = !p->side_to_move;
+    same[*count] = 1;
+
+    for (int i = 0; i < child->count; i++)
+    {
+        if (child->sq[i] == to)
+        {
+            // Captures shrink the position, the moved piece may change slot
+            child->count--;
+            child->piece[i] = child->piece[child->count];
+            child->color[i] = child->color[child->count];
+            child->sq[i] = child->sq[child->count];
+            if (slot == child->count)
+                slot = i;
+            same[*count] = 0;
+            break;
+        }
+    }
+
+    child->sq[slot] = to;
+    if (promotion != NO_PIECE)
+    {
+        child->piece[slot] = promotion;
+        same[*count] = 0;
+    }
+
+    if (!tb_in_check(child, p->side_to_move))
+        (*count)++;
+}
+
+// Legal moves of the side to move, without castling and en passant
+static int tb_children(const tb_position *p, tb_position *children, int *same)
+{
+    bitboard occupied = tb_occupied(p);
+    bitboard own = 0, enemy_king = 0;
+    int count = 0;
+    enum color us = p->side_to_move;
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->color[i] == us)
+            own |= 1ULL << p->sq[i];
+        else if (p->piece[i] == KING)
+            enemy_king |= 1ULL << p->sq[i];
+    }
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->color[i] != us)
+            continue;
+
+        if (p->piece[i] != PAWN)
+        {
+            bitboard targets = tb_piece_attacks(p->piece[i], us, p->sq[i], occupied) & ~own & ~enemy_king;
+            while (targets)
+            {
+                tb_add_child(p, children, same, &count, i, lsb(targets), NO_PIECE);
+                targets &= targets - 1;
+            }
+            continue;
+        }
+
+        int forward = us == WHITE ? 8 : -8;
+        int start_rank = us == WHITE ? 1 : 6;
+        bitboard targets = pawn_attacks(us, p->sq[i]) & occupied & ~own & ~enemy_king;
+        int push = p->sq[i] + forward;
+
+        if (!(occupied & (1ULL << push)))
+        {
+            targets |= 1ULL << push;
+            if ((p->sq[i] >> 3) == start_rank && !(occupied & (1ULL << (push + forward))))
+                targets |= 1ULL << (push + forward);
+        }
+
+        while (targets)
+        {
+            int to = lsb(targets);
+            if (to < A2 || to > H7)
+            {
+                for (enum piece promotion = QUEEN; promotion >= KNIGHT; promotion--)
+                    tb_add_child(p, children, same, &count, i, to, promotion);
+            }
+            else
+            {
+                tb_add_child(p, children, same, &count, i, to, NO_PIECE);
+            }
+            targets &= targets - 1;
+        }
+    }
+
+    return count;
+}
+
+// Positions of the same material from which the side not to move reached p
+static int tb_parents(const tb_position *p, tb_position *parents)
+{
+    bitboard occupied = tb_occupied(p);
+    enum color them = !p->side_to_move;
+    int count = 0;
+
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->color[i] != them)
+            continue;
+
+        bitboard sources;
+        if (p->piece[i] == PAWN)
+        {
+            int back = them == WHITE ? -8 : 8;
+            int from = p->sq[i] + back;
+            sources = 0;
+            if (from >= A2 && from <= H7 && !(occupied & (1ULL << from)))
+            {
+                sources |= 1ULL << from;
+                if ((p->sq[i] >> 3) == (them == WHITE ? 3 : 4) && !(occupied & (1ULL << (from + back))))
+                    sources |= 1ULL << (from + back);
+            }
+        }
+        else
+        {
+            sources = tb_piece_attacks(p->piece[i], them, p->sq[i], occupied) & ~occupied;
+        }
+
+        while (sources)
+        {
+            tb_position *parent = &parents[count];
+            *parent = *p;
+            parent->sq[i] = lsb(sources);
+            parent->side_to_move = them;
+            if (!tb_in_check(parent, p->side_to_move))
+                count++;
+            sources &= sources - 1;
+        }
+    }
+
+    return count;
+}
+
+static void tb_evaluate(tb_worker *w, unsigned long long index)
+{
+    tb_generator *gen = w->gen;
+    const tb_table *t = gen->table;
+    enum color side = w->side;
+    int pass = gen->pass;
+    tb_position p, children[TB_MAX_MOVES];
+    int same[TB_MAX_MOVES];
+
+    tb_decode(t, index, side, &p);
+    if (pass == 0 && !tb_is_legal(&p))
+    {
+        gen->state[side][index] = TB_ILLEGAL;
+        return;
+    }
+
+    int count = tb_children(&p, children, same);
+    int win = TB_MAX_DTM + 1, loss = 0, unresolved = 0;
+
+    if (count == 0)
+    {
+        if (pass == 0 && tb_in_check(&p, side))
+        {
+            gen->state[side][index] = TB_LOSS;
+            w->changes++;
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int result, dtm;
+        if (same[i])
+        {
+            // In-table results are not stable until the first pass is over
+            if (pass == 0)
+            {
+                unresolved = 1;
+                continue;
+            }
+            long long child = tb_index(t, children[i].sq);
+            result = gen->state[!side][child];
+            dtm = gen->dtm[!side][child];
+        }
+        else
+        {
+            result = tb_probe_position(&children[i], &dtm);
+        }
+
+        if (result == TB_LOSS && dtm + 1 < win)
+            win = dtm + 1;
+        else if (result == TB_WIN && dtm + 1 > loss)
+            loss = dtm + 1;
+        else if (result != TB_WIN && result != TB_LOSS)
+            unresolved = 1;
+    }
+
+    int target;
+    enum tb_wdl result;
+    if (win <= TB_MAX_DTM)
+    {
+        target = win;
+        result = TB_WIN;
+    }
+    else if (!unresolved && loss <= TB_MAX_DTM)
+    {
+        target = loss;
+        result = TB_LOSS;
+    }
+    else
+    {
+        return;
+    }
+
+    if (target == pass)
+    {
+        gen->state[side][index] = result;
+        gen->dtm[side][index] = target;
+        w->changes++;
+    }
+    else if (target > pass)
+    {
+        gen->wake[side][index] = target;
+        if (target > w->max_wake)
+            w->max_wake = target;
+    }
+}
+
+// Wakes up the parents of every position resolved in the previous pass,
+// through all symmetric images since the index keeps only one of them
+static void tb_mark(tb_worker *w, unsigned long long index)
+{
+    tb_generator *gen = w->gen;
+    const tb_table *t = gen->table;
+    enum color side = w->side;
+    tb_position p, image, parents[TB_MAX_MOVES];
+
+    tb_decode(t, index, side, &p);
+    w->changes++;
+
+    for (int transform = 0; transform < (t->has_pawns ? 2 : 8); transform++)
+    {
+        image = p;
+        for (int i = 0; i < p.count; i++)
+        {
+            if (transform & 1)
+                image.sq[i] = flip_h(image.sq[i]);
+            if (transform & 2)
+                image.sq[i] = flip_v(image.sq[i]);
+            if (transform & 4)
+                image.sq[i] = flip_d(image.sq[i]);
+        }
+
+        int count = tb_parents(&image, parents);
+        for (int i = 0; i < count; i++)
+        {
+            long long parent = tb_index(t, parents[i].sq);
+            if (parent >= 0 && gen->state[!side][parent] == TB_UNKNOWN)
+                __atomic_store_n(&gen->wake[!side][parent], (unsigned char)gen->pass, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void *tb_worker_run(void *arg)
+{
+    tb_worker *w = arg;
+    tb_generator *gen = w->gen;
+    enum color side = w->side;
+    int pass = gen->pass;
+
+    for (unsigned long long i = w->begin; i < w->end; i++)
+    {
+        if (w->phase == TB_PHASE_MARK)
+        {
+            unsigned char state = gen->state[side][i];
+            if ((state == TB_WIN || state == TB_LOSS) && gen->dtm[side][i] == pass - 1)
+                tb_mark(w, i);
+        }
+        else if (gen->state[side][i] == TB_UNKNOWN && (pass == 0 || gen->wake[side][i] == pass))
+        {
+            tb_evaluate(w, i);
+        }
+    }
+
+    return NULL;
+}
+
+static unsigned long long tb_run_phase(tb_generator *gen, enum tb_phase phase, enum color side,
+                                       int threads, int *max_wake)
+{
+    tb_worker workers[threads];
+    unsigned long long chunk = (gen->table->size + threads - 1) / threads;
+    unsigned long long changes = 0;
+
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].gen = gen;
+        workers[i].phase = phase;
+        workers[i].side = side;
+        workers[i].begin = i * chunk < gen->table->size ? i * chunk : gen->table->size;
+        workers[i].end = workers[i].begin + chunk < gen->table->size ? workers[i].begin + chunk : gen->table->size;
+        workers[i].changes = 0;
+        workers[i].max_wake = 0;
+    }
+    platform_run_jobs(tb_worker_run, workers, sizeof(workers[0]), threads);
+
+    for (int i = 0; i < threads; i++)
+    {
+        changes += workers[i].changes;
+        if (workers[i].max_wake > *max_wake)
+            *max_wake = workers[i].max_wake;
+    }
+
+    return changes;
+}
+
+static void tb_path(char *path, size_t length, const char *dir, const char *name)
+{
+    snprintf(path, length, "%s/%s.mtb", dir, name);
+}
+
+static int tb_load(const char *dir, const char *name)
+{
+    char path[4096];
+    tb_table layout;
+    struct stat st;
+
+    if (!tb_layout(&layout, name))
+        return 0;
+    if (tb_find(layout.name))
+        return 1;
+    if (table_count == TB_MAX_TABLES)
+        return 0;
+
+    tb_path(path, sizeof(path), dir, layout.name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    size_t packed = (layout.size + 3) / 4;
+    size_t expected = sizeof(tb_file_header) + 2 * packed + 2 * layout.size;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected)
+    {
+        close(fd);
+        return 0;
+    }
+
+    void *mapping = mmap(NULL, expected, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return 0;
+
+    const tb_file_header *header = mapping;
+    if (memcmp(header->magic, TB_MAGIC, 8) != 0 || strcmp(header->name, layout.name) != 0 ||
+        header->size != layout.size)
+    {
+        munmap(mapping, expected);
+        return 0;
+    }
+
+    const unsigned char *data = (const unsigned char *)mapping + sizeof(tb_file_header);
+    layout.wdl[WHITE] = data;
+    layout.wdl[BLACK] = data + packed;
+    layout.dtm[WHITE] = data + 2 * packed;
+    layout.dtm[BLACK] = data + 2 * packed + layout.size;
+    layout.max_dtm = header->max_dtm;
+    layout.mapping = mapping;
+    layout.mapping_size = expected;
+    tables[table_count++] = layout;
+    return 1;
+}
+
+static int tb_save(const char *dir, const tb_generator *gen, int max_dtm)
+{
+    const tb_table *t = gen->table;
+    size_t packed = (t->size + 3) / 4;
+    unsigned char *wdl = calloc(packed, 1);
+    char path[4096];
+    tb_file_header header;
+    int ok = 1;
+
+    if (!wdl)
+        return 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TB_MAGIC, 8);
+    strcpy(header.name, t->name);
+    header.size = t->size;
+    header.max_dtm = max_dtm;
+
+    tb_path(path, sizeof(path), dir, t->name);
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        free(wdl);
+        return 0;
+    }
+
+    ok &= fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int side = WHITE; side <= BLACK; side++)
+    {
+        memset(wdl, 0, packed);
+        for (unsigned long long i = 0; i < t->size; i++)
+            wdl[i >> 2] |= gen->state[side][i] << ((i & 3) * 2);
+        ok &= fwrite(wdl, 1, packed, file) == packed;
+    }
+    for (int side = WHITE; side <= BLACK; side++)
+        ok &= fwrite(gen->dtm[side], 1, t->size, file) == t->size;
+
+    ok &= fclose(file) == 0;
+    free(wdl);
+    return ok;
+}
+
+// Endings reached by a capture or a promotion, which have to exist first
+static int tb_dependencies(const tb_table *t, char names[][8])
+{
+    int count = 0;
+
+    for (int i = 2; i < t->count; i++)
+    {
+        tb_position p;
+        int flipped;
+
+        p.count = 0;
+        for (int j = 0; j < t->count; j++)
+        {
+            if (j == i)
+                continue;
+            p.piece[p.count] = t->piece[j];
+            p.color[p.count] = t->color[j];
+            p.count++;
+        }
+        if (p.count > 2)
+            tb_material_name(&p, names[count++], &flipped);
+
+        if (t->piece[i] != PAWN)
+            continue;
+
+        for (enum piece promotion = KNIGHT; promotion <= QUEEN; promotion++)
+        {
+            p.count = t->count;
+            memcpy(p.piece, t->piece, sizeof(t->piece));
+            memcpy(p.color, t->color, sizeof(t->color));
+            p.piece[i] = promotion;
+            tb_material_name(&p, names[count++], &flipped);
+        }
+    }
+
+    return count;
+}
+
+static int tb_build(tb_table *layout, const char *dir, int threads)
+{
+    tb_generator gen;
+    double start = platform_ms();
+    int max_wake = 0, max_dtm = 0, ok = 1;
+    unsigned long long results[4] = {0, 0, 0, 0};
+
+    gen.table = layout;
+    for (int side = WHITE; side <= BLACK; side++)
+    {
+        gen.state[side] = calloc(layout->size, 1);
+        gen.dtm[side] = calloc(layout->size, 1);
+        gen.wake[side] = calloc(layout->size, 1);
+        ok &= gen.state[side] && gen.dtm[side] && gen.wake[side];
+    }
+
+    if (ok)
+    {
+        gen.pass = 0;
+        tb_run_phase(&gen, TB_PHASE_EVALUATE, WHITE, threads, &max_wake);
+        tb_run_phase(&gen, TB_PHASE_EVALUATE, BLACK, threads, &max_wake);
+
+        for (gen.pass = 1; gen.pass <= TB_MAX_DTM; gen.pass++)
+        {
+            tb_run_phase(&gen, TB_PHASE_MARK, WHITE, threads, &max_wake);
+            tb_run_phase(&gen, TB_PHASE_MARK, BLACK, threads, &max_wake);
+            unsigned long long changes = tb_run_phase(&gen, TB_PHASE_EVALUATE, WHITE, threads, &max_wake) +
+                                         tb_run_phase(&gen, TB_PHASE_EVALUATE, BLACK, threads, &max_wake);
+            if (changes)
+                max_dtm = gen.pass;
+            else if (max_wake <= gen.pass)
+                break;
+        }
+
+        for (int side = WHITE; side <= BLACK; side++)
+        {
+            for (unsigned long long i = 0; i < layout->size; i++)
+                results[gen.state[side][i]]++;
+        }
+
+        ok = tb_save(dir, &gen, max_dtm);
+    }
+
+    for (int side = WHITE; side <= BLACK; side++)
+    {
+        free(gen.state[side]);
+        free(gen.dtm[side]);
+        free(gen.wake[side]);
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: generation failed\n", layout->name);
+        return 0;
+    }
+
+    size_t bytes = sizeof(tb_file_header) + 2 * ((layout->size + 3) / 4) + 2 * layout->size;
+    printf("%-6s %9llu positions  win %9llu  draw %9llu  loss %9llu  mate in %3d plies  %8.1f KiB  %7.2f s\n",
+           layout->name, 2 * layout->size, results[TB_WIN], results[TB_DRAW], results[TB_LOSS],
+           max_dtm, bytes / 1024.0, (platform_ms() - start) / 1000);
+    fflush(stdout);
+    return 1;
+}
+
+int tb_generate(const char *ending, const char *dir, int threads)
+{
+    tb_table layout;
+    char dependencies[TB_MAX_PIECES * 5][8];
+
+    if (!tb_layout(&layout, ending))
+    {
+        fprintf(stderr, "%s: not a valid ending of up to %d pieces\n", ending, TB_MAX_PIECES);
+        return 0;
+    }
+
+    if (tb_find(layout.name) || tb_load(dir, layout.name))
+        return 1;
+
+    int count = tb_dependencies(&layout, dependencies);
+    for (int i = 0; i < count; i++)
+    {
+        if (!tb_generate(dependencies[i], dir, threads))
+            return 0;
+    }
+
+    if (table_count == TB_MAX_TABLES)
+        return 0;
+
+    return tb_build(&layout, dir, threads < 1 ? 1 : threads) && tb_load(dir, layout.name);
+}
+
+int tb_init(const char *dir)
+{
+    static const char *sides[] = {"", "Q", "R", "B", "N", "P", "QQ", "QR", "QB", "QN", "QP", "RR", "RB",
+                                  "RN", "RP", "BB", "BN", "BP", "NN", "NP", "PP"};
+    char name[8];
+
+    tb_free();
+    for (size_t i = 0; i < sizeof(sides) / sizeof(sides[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(sides) / sizeof(sides[0]); j++)
+        {
+            if (strlen(sides[i]) + strlen(sides[j]) + 2 > TB_MAX_PIECES || strlen(sides[i]) + strlen(sides[j]) == 0)
+                continue;
+            snprintf(name, sizeof(name), "K%sK%s", sides[i], sides[j]);
+            tb_load(dir, name);
+        }
+    }
+
+    return table_count;
+}
+
+void tb_free(void)
+{
+    for (int i = 0; i < table_count; i++)
+        munmap(tables[i].mapping, tables[i].mapping_size);
+    table_count = 0;
+}
+
+int tb_probe(const board *b, int *dtm)
+{
+    tb_position p;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+
+    if (table_count == 0 || pop_count(occupied) > TB_MAX_PIECES || b->castling.white_king_side ||
+        b->castling.white_queen_side || b->castling.black_king_side || b->castling.black_queen_side)
+        return TB_NONE;
+
+    // The tables are built without en passant, so neither can a capture be on
+    if (b->en_passant != NO_SQUARE &&
+        (pawn_attacks(b->side_to_move == WHITE ? BLACK : WHITE, b->en_passant) & b->piece_bb[PAWN][b->side_to_move]))
+        return TB_NONE;
+
+    p.count = 0;
+    p.side_to_move = b->side_to_move;
+    for (int c = WHITE; c <= BLACK; c++)
+    {
+        for (int piece = PAWN; piece <= KING; piece++)
+        {
+            bitboard bb = b->piece_bb[piece][c];
+            while (bb)
+            {
+                p.piece[p.count] = (enum piece)piece;
+                p.color[p.count] = (enum color)c;
+                p.sq[p.count++] = lsb(bb);
+                bb &= bb - 1;
+            }
+        }
+    }
+
+    return tb_probe_position(&p, dtm);
+}
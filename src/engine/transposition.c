@@ -0,0 +1,200 @@
+#define _DEFAULT_SOURCE
+
+#include "transposition.h"
+#include "platform.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TT_HUGE_PAGE (2 * 1024 * 1024)
+#define TT_ALIGNMENT 64              // a cache line, entries never straddle two
+#define TT_CLEAR_CHUNK (1024 * 1024) // below this per thread the threads cost more than they save
+
+typedef struct
+{
+    unsigned char *begin;
+    size_t bytes;
+} tt_clear_job;
+
+// Maps the table on a huge page boundary so the kernel can back it with 2 MB pages
+static void *tt_map_huge(size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+    size_t padded = bytes + TT_HUGE_PAGE;
+    unsigned char *mapping = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    // Give back the unaligned head and the tail beyond the table
+    size_t head = (TT_HUGE_PAGE - (size_t)mapping % TT_HUGE_PAGE) % TT_HUGE_PAGE;
+    if (head)
+        munmap(mapping, head);
+    if (padded - head > bytes)
+        munmap(mapping + head + bytes, padded - head - bytes);
+
+    if (madvise(mapping + head, bytes, MADV_HUGEPAGE) != 0)
+    {
+        munmap(mapping + head, bytes);
+        return NULL;
+    }
+    return mapping + head;
+#else
+    (void)bytes;
+    return NULL;
+#endif
+}
+
+int tt_init(tt_table *tt, size_t megabytes)
+{
+    return tt_init_pages(tt, megabytes, TT_PAGES_HUGE, 1);
+}
+
+int tt_init_pages(tt_table *tt, size_t megabytes, enum tt_pages pages, int threads)
+{
+    if (megabytes > TT_MAX_MB || megabytes > SIZE_MAX / (1024 * 1024))
+    {
+        memset(tt, 0, sizeof(*tt));
+        return 0;
+    }
+
+    // The largest power of two number of entries that fits, counted without overflowing
+    size_t limit = megabytes * 1024 * 1024 / sizeof(tt_entry);
+    size_t count = 1;
+    while (count <= limit / 2)
+    {
+        count *= 2;
+    }
+
+    tt->count = count;
+    tt->bytes = count * sizeof(tt_entry);
+    tt->pages = pages;
+    tt->mapped = 0;
+    tt->threads = threads > 0 ? threads : 1;
+    tt->entries = NULL;
+
+    if (pages == TT_PAGES_HUGE && tt->bytes >= TT_HUGE_PAGE)
+    {
+        tt->entries = tt_map_huge(tt->bytes);
+        tt->mapped = tt->entries != NULL;
+    }
+
+    void *memory;
+    if (!tt->entries && posix_memalign(&memory, TT_ALIGNMENT, tt->bytes) == 0)
+        tt->entries = memory;
+
+    if (!tt->entries)
+    {
+        tt->count = 0;
+        tt->bytes = 0;
+        return 0;
+    }
+
+    // Faults every page in, spread over the clearing threads
+    tt_clear(tt);
+    return 1;
+}
+
+// Reallocates for the new size with the same page mode, the contents are lost; when the new
+// table cannot be allocated the old one is kept and 0 is returned
+int tt_resize(tt_table *tt, size_t megabytes)
+{
+    tt_table resized;
+    if (!tt_init_pages(&resized, megabytes, tt->pages, tt->threads))
+        return 0;
+
+    tt_free(tt);
+    *tt = resized;
+    return 1;
+}
+
+void tt_set_threads(tt_table *tt, int threads)
+{
+    tt->threads = threads > 0 ? threads : 1;
+}
+
+void tt_free(tt_table *tt)
+{
+    if (tt->mapped)
+        munmap(tt->entries, tt->bytes);
+    else
+        free(tt->entries);
+
+    tt->entries = NULL;
+    tt->count = 0;
+    tt->bytes = 0;
+    tt->mapped = 0;
+}
+
+static void *tt_clear_run(void *arg)
+{
+    tt_clear_job *job = arg;
+    memset(job->begin, 0, job->bytes);
+    return NULL;
+}
+
+void tt_clear(tt_table *tt)
+{
+    if (!tt->entries)
+        return;
+
+    int threads = tt->threads;
+    if ((size_t)threads > tt->bytes / TT_CLEAR_CHUNK)
+        threads = (int)(tt->bytes / TT_CLEAR_CHUNK);
+    if (threads <= 1)
+    {
+        memset(tt->entries, 0, tt->bytes);
+        return;
+    }
+
+    // Slices start on page boundaries of the actual addresses, the malloc fallback is only
+    // cache line aligned, so no two threads fault the same page
+    tt_clear_job jobs[threads];
+    uintptr_t page = tt->mapped ? TT_HUGE_PAGE : (uintptr_t)sysconf(_SC_PAGESIZE);
+    unsigned char *memory = (unsigned char *)tt->entries;
+    size_t bounds[threads + 1];
+
+    bounds[0] = 0;
+    bounds[threads] = tt->bytes;
+    for (int i = 1; i < threads; i++)
+    {
+        uintptr_t split = ((uintptr_t)memory + tt->bytes / threads * i + page - 1) / page * page;
+        bounds[i] = split - (uintptr_t)memory < tt->bytes ? split - (uintptr_t)memory : tt->bytes;
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        jobs[i].begin = memory + bounds[i];
+        jobs[i].bytes = bounds[i + 1] - bounds[i];
+    }
+    platform_run_jobs(tt_clear_run, jobs, sizeof(jobs[0]), threads);
+}
+
+int tt_probe(const tt_table *tt, bitboard key, tt_entry *entry)
+{
+    const tt_entry *slot = &tt->entries[key & (tt->count - 1)];
+    if (slot->key != key || slot->bound == TT_NONE)
+    {
+        return 0;
+    }
+
+    *entry = *slot;
+    return 1;
+}
+
+// Replaces the slot unless it holds a deeper result for the same position
+void tt_store(tt_table *tt, bitboard key, move best_move, int score, int depth, enum tt_bound bound)
+{
+    tt_entry *slot = &tt->entries[key & (tt->count - 1)];
+    if (slot->key == key && slot->depth > depth && bound != TT_EXACT)
+    {
+        return;
+    }
+
+    slot->key = key;
+    slot->best_move = best_move;
+    slot->score = (short)score;
+    slot->depth = (unsigned char)depth;
+    slot->bound = (unsigned char)bound;
+}
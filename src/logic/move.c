@@ -0,0 +1,29 @@
+#include "move.h"
+
+// Long algebraic notation, as used by UCI
+void move_to_string(move m, char *str)
+{
+    static const char promotion_chars[] = "pnbrqk";
+
+    if (m == MOVE_NONE)
+    {
+        str[0] = '0';
+        str[1] = '0';
+        str[2] = '0';
+        str[3] = '0';
+        str[4] = '\0';
+        return;
+    }
+
+    str[0] = 'a' + move_from(m) % 8;
+    str[1] = '1' + move_from(m) / 8;
+    str[2] = 'a' + move_to(m) % 8;
+    str[3] = '1' + move_to(m) / 8;
+    str[4] = '\0';
+
+    if (move_flag(m) == MOVE_PROMOTION)
+    {
+        str[4] = promotion_chars[move_promotion(m)];
+        str[5] = '\0';
+    }
+}
@@ -0,0 +1,198 @@
+#include "move_generator.h"
+#include "bitboard.h"
+
+static void add_move(move_list *list, enum square from, enum square to, enum move_flag flag, enum piece promotion)
+{
+    list->moves[list->count++] = move_encode(from, to, flag, promotion);
+}
+
+static void add_pawn_moves(move_list *list, bitboard targets, int offset)
+{
+    while (targets)
+    {
+        enum square to = lsb(targets);
+        enum square from = (enum square)((int)to - offset);
+
+        if (to >= A8 || to <= H1)
+        {
+            add_move(list, from, to, MOVE_PROMOTION, QUEEN);
+            add_move(list, from, to, MOVE_PROMOTION, ROOK);
+            add_move(list, from, to, MOVE_PROMOTION, BISHOP);
+            add_move(list, from, to, MOVE_PROMOTION, KNIGHT);
+        }
+        else
+        {
+            add_move(list, from, to, MOVE_NORMAL, NO_PIECE);
+        }
+        targets &= targets - 1;
+    }
+}
+
+// Pushes are limited to push_targets and captures to capture_targets, en passant is always tried
+static void generate_pawn_moves(const board *b, move_list *list, bitboard capture_targets, bitboard push_targets)
+{
+    enum color us = b->side_to_move;
+    enum color them = us == WHITE ? BLACK : WHITE;
+    bitboard pawns = b->piece_bb[PAWN][us];
+    bitboard empty = ~(b->all_pieces[WHITE] | b->all_pieces[BLACK]);
+    bitboard enemies = b->all_pieces[them] & capture_targets;
+
+    if (us == WHITE)
+    {
+        bitboard single = (pawns << 8) & empty;
+        add_pawn_moves(list, single & push_targets, 8);
+        add_pawn_moves(list, ((single & RANK_3_BB) << 8) & empty & push_targets, 16);
+        add_pawn_moves(list, ((pawns & ~FILE_A_BB) << 7) & enemies, 7);
+        add_pawn_moves(list, ((pawns & ~FILE_H_BB) << 9) & enemies, 9);
+    }
+    else
+    {
+        bitboard single = (pawns >> 8) & empty;
+        add_pawn_moves(list, single & push_targets, -8);
+        add_pawn_moves(list, ((single & RANK_6_BB) >> 8) & empty & push_targets, -16);
+        add_pawn_moves(list, ((pawns & ~FILE_H_BB) >> 7) & enemies, -7);
+        add_pawn_moves(list, ((pawns & ~FILE_A_BB) >> 9) & enemies, -9);
+    }
+
+    if (b->en_passant != NO_SQUARE)
+    {
+        bitboard capturers = pawn_attacks(them, b->en_passant) & pawns;
+        while (capturers)
+        {
+            add_move(list, lsb(capturers), b->en_passant, MOVE_EN_PASSANT, NO_PIECE);
+            capturers &= capturers - 1;
+        }
+    }
+}
+
+static void generate_piece_moves(const board *b, move_list *list, enum piece p, bitboard targets_mask)
+{
+    enum color us = b->side_to_move;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+    bitboard pieces = b->piece_bb[p][us];
+
+    while (pieces)
+    {
+        enum square from = lsb(pieces);
+        bitboard targets;
+
+        switch (p)
+        {
+        case KNIGHT:
+            targets = knight_attacks(from);
+            break;
+        case BISHOP:
+            targets = bishop_attacks(from, occupied);
+            break;
+        case ROOK:
+            targets = rook_attacks(from, occupied);
+            break;
+        case QUEEN:
+            targets = queen_attacks(from, occupied);
+            break;
+        default:
+            targets = king_attacks(from);
+            break;
+        }
+
+        targets &= targets_mask & ~b->all_pieces[us];
+        while (targets)
+        {
+            add_move(list, from, lsb(targets), MOVE_NORMAL, NO_PIECE);
+            targets &= targets - 1;
+        }
+        pieces &= pieces - 1;
+    }
+}
+
+// The king's destination is left to is_legal, only the squares it passes are checked here
+static void generate_castling_moves(const board *b, move_list *list)
+{
+    enum color us = b->side_to_move;
+    enum color them = us == WHITE ? BLACK : WHITE;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+    int king_side = us == WHITE ? b->castling.white_king_side : b->castling.black_king_side;
+    int queen_side = us == WHITE ? b->castling.white_queen_side : b->castling.black_queen_side;
+    enum square king = us == WHITE ? E1 : E8;
+    bitboard rooks = b->piece_bb[ROOK][us];
+
+    // The rights alone are not trusted, the king and rook have to stand on their home squares
+    if (b->checkers || !(b->piece_bb[KING][us] & (1ULL << king)))
+        return;
+
+    if (king_side && (rooks & (1ULL << (king + 3))) && !(occupied & ((1ULL << (king + 1)) | (1ULL << (king + 2)))) &&
+        !(board_attackers_to(b, king + 1, occupied) & b->all_pieces[them]))
+    {
+        add_move(list, king, king + 2, MOVE_CASTLING, NO_PIECE);
+    }
+
+    if (queen_side && (rooks & (1ULL << (king - 4))) && !(occupied & ((1ULL << (king - 1)) | (1ULL << (king - 2)) | (1ULL << (king - 3)))) &&
+        !(board_attackers_to(b, king - 1, occupied) & b->all_pieces[them]))
+    {
+        add_move(list, king, king - 2, MOVE_CASTLING, NO_PIECE);
+    }
+}
+
+// Pseudo-legal moves, to be filtered with is_legal
+void generate_moves(const board *b, move_list *list)
+{
+    list->count = 0;
+
+    generate_pawn_moves(b, list, ~0ULL, ~0ULL);
+    for (enum piece p = KNIGHT; p <= KING; p++)
+    {
+        generate_piece_moves(b, list, p, ~0ULL);
+    }
+    generate_castling_moves(b, list);
+}
+
+// Captures and promotions only, no quiet move is ever generated
+void generate_captures(const board *b, move_list *list)
+{
+    enum color them = b->side_to_move == WHITE ? BLACK : WHITE;
+    bitboard enemies = b->all_pieces[them];
+
+    list->count = 0;
+
+    generate_pawn_moves(b, list, enemies, b->side_to_move == WHITE ? RANK_8_BB : RANK_1_BB);
+    for (enum piece p = KNIGHT; p <= KING; p++)
+    {
+        generate_piece_moves(b, list, p, enemies);
+    }
+}
+
+// King moves, and in single check the captures of the checker and the blocks
+void generate_evasions(const board *b, move_list *list)
+{
+    enum square king = lsb(b->piece_bb[KING][b->side_to_move]);
+
+    list->count = 0;
+
+    generate_piece_moves(b, list, KING, ~0ULL);
+    if (b->checkers & (b->checkers - 1))
+    {
+        return;
+    }
+
+    bitboard targets = between_squares(king, lsb(b->checkers)) | b->checkers;
+    generate_pawn_moves(b, list, targets, targets);
+    for (enum piece p = KNIGHT; p <= QUEEN; p++)
+    {
+        generate_piece_moves(b, list, p, targets);
+    }
+}
+
+void generate_legal_moves(const board *b, move_list *list)
+{
+    move_list pseudo;
+    generate_moves(b, &pseudo);
+
+    list->count = 0;
+    for (int i = 0; i < pseudo.count; i++)
+    {
+        if (is_legal(b, pseudo.moves[i]))
+        {
+            list->moves[list->count++] = pseudo.moves[i];
+        }
+    }
+}
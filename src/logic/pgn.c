@@ -0,0 +1,539 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pgn.h"
+#include "bitboard.h"
+#include "move_generator.h"
+#include "platform.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PGN_START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define PGN_TAG_VALUE 256
+#define PGN_MIN_SLICE (256 * 1024) // smaller slices are not worth a thread
+
+enum pgn_state
+{
+    PGN_BETWEEN,
+    PGN_TAGS,
+    PGN_MOVES
+};
+
+typedef struct
+{
+    const char *text;
+    size_t length;
+    size_t base;
+    int worker;
+    const pgn_callbacks *callbacks;
+    pgn_stats stats;
+} pgn_slice;
+
+static int is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+static int is_delimiter(char c)
+{
+    return is_space(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == '[' || c == ']' || c == ';' || c == '$';
+}
+
+// Resolves a move in standard algebraic notation to the legal move of b it names, MOVE_NONE if none
+move pgn_resolve_san(const board *b, const char *san, size_t length)
+{
+    static const char pieces[] = "PNBRQK";
+    static const char promotions[] = "NBRQ";
+
+    // Check marks and annotations say nothing the board does not
+    while (length > 0 && (san[length - 1] == '+' || san[length - 1] == '#' || san[length - 1] == '!' ||
+                          san[length - 1] == '?'))
+        length--;
+    if (length > 4 && memcmp(san + length - 4, "e.p.", 4) == 0)
+        length -= 4;
+    if (length < 2)
+        return MOVE_NONE;
+
+    enum piece piece = PAWN;
+    enum piece promotion = NO_PIECE;
+    int from_file = -1;
+    int from_rank = -1;
+    int to = -1;
+    int castling = 0; // 1 for the king side, 2 for the queen side
+
+    if (san[0] == 'O' || san[0] == '0')
+    {
+        if (length == 3 && (memcmp(san, "O-O", 3) == 0 || memcmp(san, "0-0", 3) == 0))
+            castling = 1;
+        else if (length == 5 && (memcmp(san, "O-O-O", 5) == 0 || memcmp(san, "0-0-0", 5) == 0))
+            castling = 2;
+        else
+            return MOVE_NONE;
+    }
+    else
+    {
+        size_t i = 0;
+        const char *found = memchr(pieces, san[0], sizeof(pieces) - 1);
+        if (found)
+        {
+            piece = (enum piece)(found - pieces);
+            i = 1;
+        }
+
+        // Promotions are written e8=Q or e8Q
+        found = memchr(promotions, san[length - 1], sizeof(promotions) - 1);
+        if (piece == PAWN && found)
+        {
+            promotion = (enum piece)(KNIGHT + (found - promotions));
+            length -= san[length - 2] == '=' ? 2 : 1;
+        }
+
+        // Destination last, an optional file and rank of the origin before it
+        char coordinates[4];
+        int count = 0;
+        for (; i < length; i++)
+        {
+            char c = san[i];
+            if (c == 'x' || c == ':' || c == '-')
+                continue;
+            if (count == 4 || !((c >= 'a' && c <= 'h') || (c >= '1' && c <= '8')))
+                return MOVE_NONE;
+            coordinates[count++] = c;
+        }
+        if (count < 2 || coordinates[count - 2] < 'a' || coordinates[count - 1] > '8')
+            return MOVE_NONE;
+
+        to = (coordinates[count - 1] - '1') * 8 + (coordinates[count - 2] - 'a');
+        for (int c = 0; c < count - 2; c++)
+        {
+            if (coordinates[c] >= 'a')
+                from_file = coordinates[c] - 'a';
+            else
+                from_rank = coordinates[c] - '1';
+        }
+    }
+
+    if (castling)
+    {
+        move_list list;
+        generate_moves(b, &list);
+        for (int i = 0; i < list.count; i++)
+        {
+            move m = list.moves[i];
+            if (move_flag(m) == MOVE_CASTLING && (move_to(m) > move_from(m)) == (castling == 1) && is_legal(b, m))
+                return m;
+        }
+        return MOVE_NONE;
+    }
+
+    // The pieces that could have made the move are found from the destination, without a move list
+    enum color us = b->side_to_move;
+    bitboard occupied = b->all_pieces[WHITE] | b->all_pieces[BLACK];
+    bitboard target = 1ULL << to;
+    bitboard pawns = b->piece_bb[PAWN][us];
+    bitboard candidates = 0;
+
+    if ((b->all_pieces[us] | b->piece_bb[KING][us == WHITE ? BLACK : WHITE]) & target)
+        return MOVE_NONE; // own pieces and the enemy king are never captured
+
+    switch (piece)
+    {
+    case PAWN:
+        if (from_file >= 0 && from_file != to % 8)
+        {
+            if ((occupied & target) || to == (int)b->en_passant)
+                candidates = pawn_attacks(us == WHITE ? BLACK : WHITE, to) & pawns;
+        }
+        else if (!(occupied & target))
+        {
+            int forward = us == WHITE ? 8 : -8;
+            int from = to - forward;
+            int start_rank = us == WHITE ? 3 : 4; // rank of the destination of a double push
+            if (from >= 0 && from < 64 && (pawns & (1ULL << from)))
+                candidates = 1ULL << from;
+            else if (to / 8 == start_rank && !(occupied & (1ULL << from)) && (pawns & (1ULL << (from - forward))))
+                candidates = 1ULL << (from - forward);
+        }
+        break;
+    case KNIGHT:
+        candidates = knight_attacks(to) & b->piece_bb[KNIGHT][us];
+        break;
+    case BISHOP:
+        candidates = bishop_attacks(to, occupied) & b->piece_bb[BISHOP][us];
+        break;
+    case ROOK:
+        candidates = rook_attacks(to, occupied) & b->piece_bb[ROOK][us];
+        break;
+    case QUEEN:
+        candidates = queen_attacks(to, occupied) & b->piece_bb[QUEEN][us];
+        break;
+    default:
+        candidates = king_attacks(to) & b->piece_bb[KING][us];
+        break;
+    }
+
+    if (from_file >= 0)
+        candidates &= 0x0101010101010101ULL << from_file;
+    if (from_rank >= 0)
+        candidates &= 0xFFULL << (8 * from_rank);
+
+    int promoting = piece == PAWN && (to / 8 == 0 || to / 8 == 7);
+    if (promoting != (promotion != NO_PIECE))
+        return MOVE_NONE;
+
+    while (candidates)
+    {
+        enum square from = lsb(candidates);
+        candidates &= candidates - 1;
+
+        enum move_flag flag = MOVE_NORMAL;
+        if (promoting)
+            flag = MOVE_PROMOTION;
+        else if (piece == PAWN && to == (int)b->en_passant && (int)from % 8 != to % 8)
+            flag = MOVE_EN_PASSANT;
+
+        move m = move_encode(from, (enum square)to, flag, promotion);
+        if (is_legal(b, m))
+            return m;
+    }
+
+    return MOVE_NONE;
+}
+
+static const char *skip_past(const char *p, const char *end, char c)
+{
+    while (p < end && *p != c)
+        p++;
+    return p < end ? p + 1 : end;
+}
+
+// Variations nest and hold comments of their own, p is just past the opening parenthesis
+static const char *skip_variation(const char *p, const char *end)
+{
+    int depth = 1;
+
+    while (p < end && depth > 0)
+    {
+        char c = *p++;
+        if (c == '(')
+            depth++;
+        else if (c == ')')
+            depth--;
+        else if (c == '{')
+            p = skip_past(p, end, '}');
+        else if (c == ';')
+            p = skip_past(p, end, '\n');
+    }
+    return p;
+}
+
+// [Name "value"] with p past the bracket, the value is copied only for the FEN tag
+static const char *read_tag(const char *p, const char *end, int *fen, char *value)
+{
+    while (p < end && is_space(*p))
+        p++;
+    const char *name = p;
+    while (p < end && !is_space(*p) && *p != '"' && *p != ']')
+        p++;
+    *fen = p - name == 3 && memcmp(name, "FEN", 3) == 0;
+
+    while (p < end && *p != '"' && *p != ']' && *p != '\n')
+        p++;
+    if (p < end && *p == '"')
+    {
+        size_t length = 0;
+        for (p++; p < end && *p != '"' && *p != '\n'; p++)
+        {
+            if (*p == '\\' && p + 1 < end)
+                p++;
+            if (*fen && length < PGN_TAG_VALUE - 1)
+                value[length++] = *p;
+        }
+        if (*fen)
+            memset(value + length, 0, PGN_TAG_VALUE - length);
+    }
+
+    // Tags end with their line, even without the bracket
+    while (p < end && *p != ']' && *p != '\n')
+        p++;
+    return p < end ? p + 1 : end;
+}
+
+static int read_result(const char *token, size_t length, enum pgn_result *result)
+{
+    if (length == 1 && token[0] == '*')
+        *result = PGN_UNKNOWN;
+    else if (length == 3 && memcmp(token, "1-0", 3) == 0)
+        *result = PGN_WHITE_WINS;
+    else if (length == 3 && memcmp(token, "0-1", 3) == 0)
+        *result = PGN_BLACK_WINS;
+    else if (length == 7 && memcmp(token, "1/2-1/2", 7) == 0)
+        *result = PGN_DRAW;
+    else
+        return 0;
+    return 1;
+}
+
+static void begin_game(pgn_game *game, board *b, const board *start, size_t offset)
+{
+    *b = *start;
+    game->offset = offset;
+    game->ply = 0;
+    game->result = PGN_UNKNOWN;
+    game->error = 0;
+}
+
+static void finish_game(const pgn_game *game, const pgn_callbacks *callbacks, pgn_stats *stats)
+{
+    stats->games++;
+    stats->moves += game->ply;
+    stats->errors += game->error != 0;
+    if (callbacks->on_game)
+        callbacks->on_game(callbacks->user, game);
+}
+
+// Parses the games of a buffer on the calling thread, adding to stats; base is the buffer's offset in its file
+void pgn_parse(const char *text, size_t length, size_t base, int worker, const pgn_callbacks *callbacks,
+               pgn_stats *stats)
+{
+    const char *p = text;
+    const char *end = text + length;
+    enum pgn_state state = PGN_BETWEEN;
+    char value[PGN_TAG_VALUE];
+    board start;
+    board b;
+    pgn_game game;
+
+    board_from_fen(&start, PGN_START_FEN);
+    memset(&game, 0, sizeof(game));
+    game.worker = worker;
+
+    while (p < end)
+    {
+        char c = *p;
+        if (is_space(c))
+        {
+            p++;
+            continue;
+        }
+
+        if (c == '[')
+        {
+            // Tags after movetext open the next game, whether or not a result closed the last one
+            if (state == PGN_MOVES)
+                finish_game(&game, callbacks, stats);
+            if (state != PGN_TAGS)
+                begin_game(&game, &b, &start, base + (size_t)(p - text));
+            state = PGN_TAGS;
+
+            int fen;
+            p = read_tag(p + 1, end, &fen, value);
+            if (fen && !board_from_fen(&b, value))
+                game.error = 1;
+            continue;
+        }
+        if (c == '{')
+        {
+            p = skip_past(p + 1, end, '}');
+            continue;
+        }
+        if (c == ';' || (c == '%' && (p == text || p[-1] == '\n')))
+        {
+            p = skip_past(p + 1, end, '\n');
+            continue;
+        }
+        if (c == '(')
+        {
+            p = skip_variation(p + 1, end);
+            continue;
+        }
+        if (c == '$')
+        {
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+                ;
+            continue;
+        }
+        if (c == ')' || c == '}' || c == ']')
+        {
+            p++;
+            continue;
+        }
+
+        // Move number, move or result
+        const char *token = p;
+        while (p < end && !is_delimiter(*p))
+            p++;
+        size_t token_length = (size_t)(p - token);
+
+        if (read_result(token, token_length, &game.result))
+        {
+            if (state != PGN_BETWEEN)
+                finish_game(&game, callbacks, stats);
+            state = PGN_BETWEEN;
+            continue;
+        }
+
+        // Movetext without tags is a game of its own too
+        if (state == PGN_BETWEEN)
+            begin_game(&game, &b, &start, base + (size_t)(token - text));
+        state = PGN_MOVES;
+
+        // Move numbers may be glued to the move, as in 1.e4 or 12...Nf6
+        if (*token >= '1' && *token <= '9')
+        {
+            size_t skip = 0;
+            while (skip < token_length && token[skip] >= '0' && token[skip] <= '9')
+                skip++;
+            while (skip < token_length && token[skip] == '.')
+                skip++;
+            token += skip;
+            token_length -= skip;
+            if (token_length == 0)
+                continue;
+        }
+
+        // Annotations and en passant marks standing on their own
+        size_t marks = 0;
+        while (marks < token_length && (token[marks] == '!' || token[marks] == '?'))
+            marks++;
+        if (game.error || marks == token_length || (token_length == 4 && memcmp(token, "e.p.", 4) == 0))
+            continue;
+
+        move m = pgn_resolve_san(&b, token, token_length);
+        if (m == MOVE_NONE)
+        {
+            game.error = 1;
+            continue;
+        }
+
+        if (callbacks->on_move)
+            callbacks->on_move(callbacks->user, &game, &b, m);
+        board_make_move(&b, m);
+        game.ply++;
+    }
+
+    if (state != PGN_BETWEEN)
+        finish_game(&game, callbacks, stats);
+}
+
+// First line at or after offset that opens a tag section following movetext, the start of a game
+static size_t game_boundary(const char *text, size_t size, size_t offset)
+{
+    while (offset > 0 && text[offset - 1] != '\n')
+        offset--;
+
+    // Whether the last non blank line before offset was movetext
+    int after_moves = 1;
+    size_t q = offset;
+    while (q > 0 && is_space(text[q - 1]))
+        q--;
+    if (q > 0)
+    {
+        while (q > 0 && text[q - 1] != '\n')
+            q--;
+        while (text[q] == ' ' || text[q] == '\t')
+            q++;
+        after_moves = text[q] != '[';
+    }
+
+    while (offset < size)
+    {
+        size_t first = offset;
+        while (first < size && (text[first] == ' ' || text[first] == '\t' || text[first] == '\r'))
+            first++;
+        if (first < size && text[first] != '\n')
+        {
+            if (text[first] == '[')
+            {
+                if (after_moves)
+                    return offset;
+            }
+            else
+            {
+                after_moves = 1;
+            }
+        }
+        while (offset < size && text[offset] != '\n')
+            offset++;
+        offset++;
+    }
+    return size;
+}
+
+static void *pgn_slice_run(void *arg)
+{
+    pgn_slice *slice = arg;
+    pgn_parse(slice->text, slice->length, slice->base, slice->worker, slice->callbacks, &slice->stats);
+    return NULL;
+}
+
+// Maps the archive and parses it on up to threads threads, each taking a run of whole games
+int pgn_read_file(const char *path, int threads, const pgn_callbacks *callbacks, pgn_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+        return 0;
+    posix_madvise((void *)text, size, POSIX_MADV_SEQUENTIAL);
+
+    if (threads > PGN_MAX_THREADS)
+        threads = PGN_MAX_THREADS;
+    if ((size_t)threads > size / PGN_MIN_SLICE)
+        threads = (int)(size / PGN_MIN_SLICE);
+    if (threads < 1)
+        threads = 1;
+
+    size_t bounds[PGN_MAX_THREADS + 1];
+    bounds[0] = 0;
+    bounds[threads] = size;
+    for (int i = 1; i < threads; i++)
+    {
+        bounds[i] = game_boundary(text, size, size / threads * i);
+        if (bounds[i] < bounds[i - 1])
+            bounds[i] = bounds[i - 1];
+    }
+
+    pgn_slice slices[threads];
+    double start = platform_ms();
+
+    for (int i = 0; i < threads; i++)
+    {
+        memset(&slices[i], 0, sizeof(slices[i]));
+        slices[i].text = text + bounds[i];
+        slices[i].length = bounds[i + 1] - bounds[i];
+        slices[i].base = bounds[i];
+        slices[i].worker = i;
+        slices[i].callbacks = callbacks;
+    }
+    platform_run_jobs(pgn_slice_run, slices, sizeof(slices[0]), threads);
+
+    for (int i = 0; i < threads; i++)
+    {
+        stats->games += slices[i].stats.games;
+        stats->moves += slices[i].stats.moves;
+        stats->errors += slices[i].stats.errors;
+    }
+    stats->bytes = size;
+    stats->ms = platform_ms() - start;
+
+    munmap((void *)text, size);
+    return 1;
+}
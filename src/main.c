@@ -1,4 +1,243 @@
-int main(int argc, char *argv[])
+#define _POSIX_C_SOURCE 200809L
+
+#include "analysis.h"
+#include "bench.h"
+#include "pgn.h"
+#include "search.h"
+#include "tablebase.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TB_DEFAULT_DIR "tb"
+
+static int tbgen_command(int argc, char *argv[])
 {
+    static char *default_endings[] = {"KQK", "KRK", "KBK", "KNK", "KPK", "KBNK", "KQKR", "KRKB", "KRKN", "KRKP", "KQKP"};
+    const char *dir = TB_DEFAULT_DIR;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 0;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            dir = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: tbgen [-d dir] [-t threads] [ending...]\n");
+            return 1;
+        }
+    }
+
+    mkdir(dir, 0755);
+    if (i == argc)
+    {
+        argv = default_endings;
+        argc = sizeof(default_endings) / sizeof(default_endings[0]);
+        i = 0;
+    }
+
+    for (; i < argc; i++)
+    {
+        if (!tb_generate(argv[i], dir, threads))
+            return 1;
+    }
+
+    tb_free();
     return 0;
-}
\ No newline at end of file
+}
+
+// -s dumps the search counters, which exist only in builds with make STATS=1
+static int stats_flag(void)
+{
+#ifdef SEARCH_STATS
+    return 1;
+#else
+    fprintf(stderr, "-s needs a build with make STATS=1\n");
+    return -1;
+#endif
+}
+
+static int analyse_command(int argc, char *argv[])
+{
+    analysis_options options;
+    memset(&options, 0, sizeof(options));
+    options.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    options.hash_mb = ANALYSIS_DEFAULT_HASH_MB;
+
+    int i = 0;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc)
+        {
+            long hash_mb = strtol(argv[++i], NULL, 10);
+            if (hash_mb < 1 || hash_mb > TT_MAX_MB)
+            {
+                fprintf(stderr, "analyse: the hash size has to be between 1 and %d MB\n", TT_MAX_MB);
+                return 1;
+            }
+            options.hash_mb = (size_t)hash_mb;
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            options.limits.depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            options.limits.time_ms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0)
+            options.json = 1;
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            if ((options.limits.print_stats = stats_flag()) < 0)
+                return 1;
+        }
+        else
+            break;
+    }
+
+    if (i + 1 != argc)
+    {
+        fprintf(stderr, "usage: analyse [-t threads] [-H hash_mb] [-d depth] [-m movetime_ms] [-j] [-s] file\n");
+        return 1;
+    }
+
+    // A move time alone searches as deep as the time allows
+    if (options.limits.depth <= 0)
+        options.limits.depth = options.limits.time_ms > 0 ? MAX_PLY : ANALYSIS_DEFAULT_DEPTH;
+
+    tb_init(TB_DEFAULT_DIR);
+    int result = analyse_file(argv[i], &options);
+    tb_free();
+    return result;
+}
+
+// Per worker, a line each so the parsing threads do not share one
+typedef struct
+{
+    bitboard checksum;
+    unsigned long long results[4];
+} __attribute__((aligned(64))) pgn_totals;
+
+// Sums position keys and packed moves, a check that splitting the file does not change what is read
+static void pgn_count_move(void *user, const pgn_game *game, const board *b, move m)
+{
+    pgn_totals *totals = (pgn_totals *)user + game->worker;
+    totals->checksum += b->key ^ move_pack(m);
+}
+
+static void pgn_count_game(void *user, const pgn_game *game)
+{
+    pgn_totals *totals = (pgn_totals *)user + game->worker;
+    totals->results[game->result]++;
+}
+
+static int pgn_command(int argc, char *argv[])
+{
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 0;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else
+            break;
+    }
+    if (i + 1 != argc)
+    {
+        fprintf(stderr, "usage: pgn [-t threads] file\n");
+        return 1;
+    }
+
+    static pgn_totals totals[PGN_MAX_THREADS];
+    pgn_callbacks callbacks = {pgn_count_move, pgn_count_game, totals};
+    pgn_stats stats;
+    if (!pgn_read_file(argv[i], threads, &callbacks, &stats))
+    {
+        fprintf(stderr, "pgn: cannot read %s\n", argv[i]);
+        return 1;
+    }
+
+    pgn_totals sum;
+    memset(&sum, 0, sizeof(sum));
+    for (int w = 0; w < PGN_MAX_THREADS; w++)
+    {
+        sum.checksum += totals[w].checksum;
+        for (int r = 0; r < 4; r++)
+            sum.results[r] += totals[w].results[r];
+    }
+
+    double seconds = (stats.ms > 0 ? stats.ms : 1e-3) / 1000.0;
+    printf("Games           : %llu\n", stats.games);
+    printf("Moves           : %llu\n", stats.moves);
+    printf("Errors          : %llu\n", stats.errors);
+    printf("Results         : 1-0 %llu, 0-1 %llu, 1/2-1/2 %llu, * %llu\n", sum.results[PGN_WHITE_WINS],
+           sum.results[PGN_BLACK_WINS], sum.results[PGN_DRAW], sum.results[PGN_UNKNOWN]);
+    printf("Checksum        : %016llx\n", (unsigned long long)sum.checksum);
+    printf("Time (ms)       : %.0f\n", stats.ms);
+    printf("Games/second    : %.0f\n", stats.games / seconds);
+    printf("Moves/second    : %.0f\n", stats.moves / seconds);
+    printf("MB/second       : %.1f\n", stats.bytes / seconds / (1024 * 1024));
+    return 0;
+}
+
+// bench [-s] [depth] [technique...], the named selective search techniques are switched off
+static int bench_command(int argc, char *argv[])
+{
+    int print_stats = 0;
+    if (argc > 0 && strcmp(argv[0], "-s") == 0)
+    {
+        if ((print_stats = stats_flag()) < 0)
+            return 1;
+        argc--;
+        argv++;
+    }
+
+    // A number is the depth, anything else has to name a technique
+    int depth = BENCH_DEFAULT_DEPTH;
+    int disabled = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (argv[i][strspn(argv[i], "0123456789")] == '\0')
+        {
+            depth = atoi(argv[i]);
+            if (depth < 1)
+            {
+                fprintf(stderr, "bench: the depth has to be at least 1\n");
+                return 1;
+            }
+            continue;
+        }
+
+        int flag = search_technique(argv[i]);
+        if (!flag)
+        {
+            fprintf(stderr, "bench: %s is neither a depth nor a technique (null, lmr, rfp, futility, lmp)\n", argv[i]);
+            return 1;
+        }
+        disabled |= flag;
+    }
+
+    return bench_run(depth, disabled, print_stats);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return bench_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "analyse") == 0)
+        return analyse_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "pgn") == 0)
+        return pgn_command(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "perft") == 0)
+        return perft_run();
+    if (argc > 1 && strcmp(argv[1], "tbgen") == 0)
+        return tbgen_command(argc - 2, argv + 2);
+
+    fprintf(stderr, "usage: chess_engine bench|analyse|perft|pgn|tbgen [options]\n");
+    return 1;
+}